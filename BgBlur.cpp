@@ -7,6 +7,7 @@
 #include <windows.h>
 
 #include "Models.h"
+#include "OrtRegistry.h"
 
 #include "FilterData.h"
 
@@ -35,43 +36,71 @@ void *BgBlur::obs_create(obs_data_t *settings, obs_source_t *source)
 	FilterData *filterD = new FilterData;
 	filterD->source = source;
 	filterD->texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
-	filterD->env = std::make_unique<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "bgremove-ort");
-
-	// Default to just one for now, no selection option
-	filterD->modelSelection = MODEL_MEDIAPIPE;
-	
-	if (filterD->modelSelection == MODEL_SINET)
-		filterD->model = std::make_unique<ModelSINET>();
-	else if (filterD->modelSelection == MODEL_SELFIE)
-		filterD->model = std::make_unique<ModelSelfie>();
-	else if (filterD->modelSelection == MODEL_MEDIAPIPE)
-		filterD->model = std::make_unique<ModelMediaPipe>();
-	else if (filterD->modelSelection == MODEL_RVM)
-		filterD->model = std::make_unique<ModelRVM>();
-	else if (filterD->modelSelection == MODEL_PPHUMANSEG)
-		filterD->model = std::make_unique<ModelPPHumanSeg>();
-	else if (filterD->modelSelection == MODEL_DEPTH_TCMONODEPTH)
-		filterD->model = std::make_unique<ModelTCMonoDepth>();
-	else if(filterD->modelSelection == MODEL_RMBG)
-		filterD->model = std::make_unique<ModelRMBG>();
-
-	int ortSessionResult = BgBlurGraphics::createOrtSession(filterD);
-	if (ortSessionResult != OBS_BGREMOVAL_ORT_SESSION_SUCCESS)
-	{
-		blog(LOG_ERROR, "Failed to create ONNXRuntime session. Error code: %d", ortSessionResult);
-		delete filterD;
-		return nullptr;
-	}
 
+	// Requests the model session, which is built in the background; frames pass through until it is ready, and a
+	//	failure is shown in the filter's properties instead of failing the source
 	obs_update_settings(filterD, settings);
+	BgBlurWorker::start(filterD);
 	return (void *)filterD;
 }
 
 /*static*/
 void BgBlur::obs_video_tick(void *data, float seconds)
 {
-	UNUSED_PARAMETER(data);
-	UNUSED_PARAMETER(seconds);
+	FilterData *filterD = (FilterData *)data;
+
+	if (!filterD->enableStats && !filterD->verifyMaskPostprocess)
+		return;
+
+	filterD->stats.secondsSinceLog += seconds;
+
+	if (filterD->stats.secondsSinceLog < STATS_LOG_INTERVAL_SECONDS)
+		return;
+
+	filterD->stats.secondsSinceLog = 0.0f;
+
+	if (filterD->verifyMaskPostprocess)
+	{
+		const uint64_t verifyPixels = filterD->stats.verifyPixels.exchange(0);
+		const uint64_t verifyMismatchedPixels = filterD->stats.verifyMismatchedPixels.exchange(0);
+		const double mismatchFraction = verifyPixels ? (double)verifyMismatchedPixels / (double)verifyPixels : 0.0;
+
+		blog(mismatchFraction > MASK_VERIFY_PIXEL_TOLERANCE ? LOG_WARNING : LOG_INFO, "BgBlur mask verify: pixels=%llu mismatched=%llu (%.4f%%) maxDifference=%llu",
+		     (unsigned long long)verifyPixels, (unsigned long long)verifyMismatchedPixels, mismatchFraction * 100.0,
+		     (unsigned long long)filterD->stats.verifyMaxDifference.exchange(0));
+	}
+
+	if (!filterD->enableStats)
+		return;
+
+	const uint64_t inferenceCount = filterD->stats.inferenceCount.exchange(0);
+	const uint64_t inferenceNs = filterD->stats.inferenceNs.exchange(0);
+	const uint64_t stagedFrames = filterD->stats.stagedFrames.exchange(0);
+	const uint64_t stagedBytes = filterD->stats.stagedBytes.exchange(0);
+	const uint64_t framesRendered = filterD->stats.framesRendered.exchange(0);
+	const uint64_t renderNs = filterD->stats.renderNs.exchange(0);
+	const uint64_t blurGpuSamples = filterD->stats.blurGpuSamples.exchange(0);
+	const uint64_t blurGpuNs = filterD->stats.blurGpuNs.exchange(0);
+	const uint64_t blurCacheFullRedraws = filterD->stats.blurCacheFullRedraws.exchange(0);
+	const uint64_t blurCacheTilesRedrawn = filterD->stats.blurCacheTilesRedrawn.exchange(0);
+	const uint64_t propagatedMasks = filterD->stats.propagatedMasks.exchange(0);
+	const uint64_t propagationNs = filterD->stats.propagationNs.exchange(0);
+	const uint64_t batchedInferences = filterD->stats.batchedInferences.exchange(0);
+	const uint64_t batchSizeSum = filterD->stats.batchSizeSum.exchange(0);
+	const uint64_t fullResCount = filterD->stats.fullResCount.exchange(0);
+	const uint64_t fullResNs = filterD->stats.fullResNs.exchange(0);
+
+	blog(LOG_INFO, "BgBlur stats: rendered=%llu masks=%llu inferenceAvg=%.2fms maskLag=%llu maxMaskLag=%llu staleMaskFrames=%llu stagedBytesPerFrame=%llu steadyStateAllocs=%llu renderCpuAvg=%.3fms blurGpuAvg=%.3fms blurCacheFullRedraws=%llu blurCacheTiles=%llu maskCadence=%u propagated=%llu propagationAvg=%.3fms fullResAvg=%.3fms postprocessThreads=%u batchAvg=%.2f warmup=%.1fms warmupSteadyRun=%.2fms",
+	     (unsigned long long)framesRendered, (unsigned long long)filterD->stats.masksPublished.exchange(0),
+	     inferenceCount ? (double)inferenceNs / (double)inferenceCount / 1000000.0 : 0.0, (unsigned long long)filterD->stats.maskLagFrames.load(),
+	     (unsigned long long)filterD->stats.maxMaskLagFrames.exchange(0), (unsigned long long)filterD->stats.staleMaskFrames.exchange(0),
+	     (unsigned long long)(stagedFrames ? stagedBytes / stagedFrames : 0), (unsigned long long)filterD->scratch.steadyStateAllocations.load(),
+	     framesRendered ? (double)renderNs / (double)framesRendered / 1000000.0 : 0.0, blurGpuSamples ? (double)blurGpuNs / (double)blurGpuSamples / 1000000.0 : 0.0,
+	     (unsigned long long)blurCacheFullRedraws, (unsigned long long)blurCacheTilesRedrawn, (unsigned)filterD->stats.maskCadence.load(),
+	     (unsigned long long)propagatedMasks, propagatedMasks ? (double)propagationNs / (double)propagatedMasks / 1000000.0 : 0.0,
+	     fullResCount ? (double)fullResNs / (double)fullResCount / 1000000.0 : 0.0, (unsigned)filterD->postprocessThreads.load(),
+	     batchedInferences ? (double)batchSizeSum / (double)batchedInferences : 1.0, (double)filterD->stats.warmupNs.load() / 1000000.0,
+	     (double)filterD->stats.warmupSteadyRunNs.load() / 1000000.0);
 }
 
 /*static*/
@@ -87,6 +116,14 @@ void BgBlur::obs_video_render(void *data, gs_effect_t *_effect)
 		return;
 	}
 
+	if (filterD->sessionState != SESSION_READY)
+	{
+		obs_source_skip_video_filter(filterD->source);
+		return;
+	}
+
+	const uint64_t renderStart = os_gettime_ns();
+
 	uint32_t width = 0, height = 0;
 	if (!BgBlurGraphics::getRGBAFromStageSurface(filterD, width, height) || !filterD->maskEffect)
 	{
@@ -95,207 +132,77 @@ void BgBlur::obs_video_render(void *data, gs_effect_t *_effect)
 	}
 
 	/***
-	* Build mask
+	* Pick up mask
 	*/
 
-	// Try to grab the latest BGRA frame (non-blocking).
-	cv::Mat imageBGRA;
-	{
-		std::unique_lock<std::mutex> lock(filterD->inputBGRALock, std::try_to_lock);
-		if (lock.owns_lock() && !filterD->inputBGRA.empty())
-			imageBGRA = filterD->inputBGRA.clone();
-	}
-
-	// If we have a new frame, decide whether to update the mask this render.
-	bool haveNewFrame = !imageBGRA.empty();
-	bool doProcess = haveNewFrame;
+	// The mask worker runs inference on the frames submitted above; only take its newest finished mask here, never wait for it.
+	//	A fetched mask stays marked for upload until a frame actually renders it, so the lag passthrough below can't drop it.
+	if (BgBlurWorker::fetchMask(filterD))
+		filterD->maskTextureStale = true;
 
-	// Image-similarity skip (keep previous mask; DO NOT update lastImage if we skip)
-	if (doProcess && filterD->enableImageSimilarity && !filterD->lastImageBGRA.empty() && filterD->lastImageBGRA.size() == imageBGRA.size())
+	if (!filterD->backgroundMask.empty())
 	{
-		const double psnr = cv::PSNR(filterD->lastImageBGRA, imageBGRA);
-		if (psnr > filterD->imageSimilarityThreshold)
-			doProcess = false; // skip updating the mask this frame
-	}
-
-	// Initialize first mask once we have a first frame
-	if (filterD->backgroundMask.empty() && haveNewFrame)
-		filterD->backgroundMask = cv::Mat(imageBGRA.size(), CV_8UC1, cv::Scalar(255));
+		const uint64_t lag = filterD->frameCounter - filterD->maskCheckedFrameId.load();
+		filterD->stats.maskLagFrames = lag;
 
-	// Mask update cadence (every X frames)
-	if (doProcess && filterD->maskEveryXFrames > 1)
-	{
-		filterD->maskEveryXFramesCount = (filterD->maskEveryXFramesCount + 1) % filterD->maskEveryXFrames;
-		if (filterD->maskEveryXFramesCount != 0 && !filterD->backgroundMask.empty())
-			doProcess = false; // reuse previous mask
-	}
+		if (lag > filterD->stats.maxMaskLagFrames)
+			filterD->stats.maxMaskLagFrames = lag;
 
-	// Compute/refresh mask if needed
-	if (doProcess)
-	{
-		try
-		{
-			if (!filterD->model)
-			{
-				blog(LOG_ERROR, "Model is not initialized");
-			}
-			else
-			{
-				cv::Mat backgroundMask;
-
-				{
-					// Process the image to find the mask.
-					std::unique_lock<std::mutex> lock(filterD->modelMutex);
-
-					cv::Mat outputImage;
-
-					if (!BgBlurGraphics::runFilterModelInference(filterD, imageBGRA, outputImage))
-						return;
-
-					if (filterD->enableThreshold)
-					{
-						// We need to make filterD->threshold (float [0,1]) be in that range
-						const uint8_t threshold_value = (uint8_t)(filterD->threshold * 255.0f);
-						backgroundMask = outputImage < threshold_value;
-					}
-					else
-					{
-						backgroundMask = 255 - outputImage;
-					}
-				}
-
-				if (!backgroundMask.empty())
-				{
-					// Temporal smoothing (optionally clamped by threshold)
-					if (filterD->temporalSmoothFactor > 0.0 && filterD->temporalSmoothFactor < 1.0 && !filterD->lastBackgroundMask.empty() && filterD->lastBackgroundMask.size() == backgroundMask.size())
-					{
-						float t = filterD->temporalSmoothFactor;
-						if (filterD->enableThreshold)
-							t = std::max(t, filterD->threshold);
-
-						// If the current mask differs a lot from the previous, don’t smooth this frame.
-						// Use a depth-aware epsilon so this works for 8-bit and float masks.
-						double eps;
-						switch (backgroundMask.depth())
-						{
-						case CV_8U:
-						case CV_8S:
-						case CV_16U:
-						case CV_16S:
-							eps = 5.0;
-							break; // pixel levels for integer masks
-						case CV_32F:
-						case CV_64F:
-						default:
-							eps = 0.02;
-							break; // normalized float masks
-						}
-
-						const double maxDiff = cv::norm(backgroundMask, filterD->lastBackgroundMask, cv::NORM_INF);
-						if (maxDiff <= eps)
-						{
-							cv::addWeighted(backgroundMask, t, filterD->lastBackgroundMask, 1.0f - t, 0.0, backgroundMask);
-						}
-					}
-
-					filterD->lastBackgroundMask = backgroundMask.clone();
-
-					// Contour processing (only when thresholding → binary)
-					if (filterD->enableThreshold)
-					{
-						if (filterD->contourFilter > 0.0 && filterD->contourFilter < 1.0)
-						{
-							std::vector<std::vector<cv::Point>> contours, filtered;
-							findContours(backgroundMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-							const double contourSizeThreshold = (double)backgroundMask.total() * filterD->contourFilter;
-							for (auto &c : contours)
-								if (cv::contourArea(c) > contourSizeThreshold)
-									filtered.push_back(c);
-							backgroundMask.setTo(0);
-							drawContours(backgroundMask, filtered, -1, cv::Scalar(255), -1);
-						}
-
-						if (filterD->smoothContour > 0.0)
-						{
-							int k = (int)(3 + 11 * filterD->smoothContour);
-							if ((k & 1) == 0)
-								++k;
-							cv::stackBlur(backgroundMask, backgroundMask, cv::Size(k, k));
-						}
-
-						// Resize mask back to input image size
-						cv::resize(backgroundMask, backgroundMask, imageBGRA.size());
-
-						// If we smoothed, re-binarize
-						if (filterD->smoothContour > 0.0)
-							backgroundMask = backgroundMask > 128;
-
-						if (filterD->feather > 0.0f)
-						{
-							int k = std::max(3, 2 * (int)std::round(filterD->feather) + 1);
-							const int dilateIters = std::max(1, k / 3);
-							cv::dilate(backgroundMask, backgroundMask, cv::Mat(), cv::Point(-1, -1), dilateIters);
-						}
-					}
-
-					// Commit the new mask
-					backgroundMask.copyTo(filterD->backgroundMask);
-				}
-				else
-				{
-					blog(LOG_WARNING, "Background mask is empty. Using previous mask.");
-				}
-			}
-		}
-		catch (const Ort::Exception &e)
-		{
-			blog(LOG_ERROR, "ONNXRuntime Exception: %s", e.what());
-		}
-		catch (const std::exception &e)
+		if (filterD->maxMaskLagFrames > 0 && lag > (uint64_t)filterD->maxMaskLagFrames)
 		{
-			blog(LOG_ERROR, "%s", e.what());
+			filterD->stats.staleMaskFrames++;
+			obs_source_skip_video_filter(filterD->source);
+			return;
 		}
 	}
 
-	// Update lastImageBGRA only when we actually processed (mirrors original early-return behavior)
-	if (haveNewFrame && filterD->enableImageSimilarity && doProcess)
-		filterD->lastImageBGRA = imageBGRA.clone();
+	filterD->stats.framesRendered++;
 
 	// If we still have no mask, create a fallback (all-foreground) at render size
 	if (filterD->backgroundMask.empty())
+	{
 		filterD->backgroundMask = cv::Mat(cv::Size((int)width, (int)height), CV_8UC1, cv::Scalar(255));
+		filterD->maskTextureStale = true;
+	}
 
 	/***
 	* Rendering
 	*/
 
-	gs_texture_t *alphaTexture = nullptr;
-
+	// Persistent texture, only re-uploaded when a new mask was committed
+	if (!BgBlurGraphics::updateMaskTexture(filterD))
 	{
-		std::lock_guard<std::mutex> lock(filterD->outputLock);
-		alphaTexture = gs_texture_create(filterD->backgroundMask.cols, filterD->backgroundMask.rows, GS_R8, 1, (const uint8_t **)&filterD->backgroundMask.data, 0);
+		blog(LOG_ERROR, "Failed to create alpha texture");
+		obs_source_skip_video_filter(filterD->source);
+		return;
+	}
 
-		if (!alphaTexture)
-		{
-			blog(LOG_ERROR, "Failed to create alpha texture");
-			obs_source_skip_video_filter(filterD->source);
-			return;
-		}
+	gs_texture_t *alphaTexture = filterD->maskTexture;
+
+	// Guided upsampling coefficients instead of a mask: resolve them against this frame first
+	if (filterD->backgroundMask.type() == CV_32FC2)
+		alphaTexture = BgBlurGraphics::renderGuidedMask(filterD, width, height);
+
+	if (!alphaTexture)
+	{
+		obs_source_skip_video_filter(filterD->source);
+		return;
 	}
 
+	alphaTexture = BgBlurGraphics::dilateMask(filterD, alphaTexture, width, height);
+
 	gs_texture_t *blurredTexture = BgBlurGraphics::blurBackground(filterD, width, height, alphaTexture);
 
 	if (!obs_source_process_filter_begin(filterD->source, GS_RGBA, OBS_ALLOW_DIRECT_RENDERING))
 	{
 		obs_source_skip_video_filter(filterD->source);
-		gs_texture_destroy(alphaTexture);
-		gs_texture_destroy(blurredTexture);
 		return;
 	}
 
 	gs_eparam_t *alphamask = gs_effect_get_param_by_name(filterD->maskEffect, "alphamask");
 	gs_eparam_t *blurredBackground = gs_effect_get_param_by_name(filterD->maskEffect, "blurredBackground");
 	gs_effect_set_texture(alphamask, alphaTexture);
+	BgBlurGraphics::setMaskSamplingParams(filterD, filterD->maskEffect, width, height);
 
 	if (filterD->blurBackground > 0)
 		gs_effect_set_texture(blurredBackground, blurredTexture);
@@ -303,17 +210,21 @@ void BgBlur::obs_video_render(void *data, gs_effect_t *_effect)
 	gs_blend_state_push();
 	gs_reset_blend_state();
 
+	// The blur cache holds background only (hidden background where the person stands), so the foreground is
+	//	blended in from the live frame instead of being taken from the blurred texture
+	const bool blurCached = filterD->enableBlurCache && filterD->blurMode != BLUR_MODE_DUAL_KAWASE;
+
 	const char *techName;
 	if (filterD->blurBackground > 0)
-		techName = "DrawWithBlur";
+		techName = blurCached ? "DrawWithBlurCached" : "DrawWithBlur";
 	else
 		techName = "DrawWithoutBlur";
 
 	obs_source_process_filter_tech_end(filterD->source, filterD->maskEffect, 0, 0, techName);
 
 	gs_blend_state_pop();
-	gs_texture_destroy(alphaTexture);
-	gs_texture_destroy(blurredTexture);
+
+	filterD->stats.renderNs += os_gettime_ns() - renderStart;
 }
 
 /*static*/
@@ -328,21 +239,64 @@ void BgBlur::obs_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, "model_select", MODEL_MEDIAPIPE);
 	obs_data_set_default_int(settings, "mask_every_x_frames", 1);
 	obs_data_set_default_int(settings, "blur_background", 10);
-	obs_data_set_default_int(settings, "numThreads", 1);
+	obs_data_set_default_int(settings, "numThreads", 0);
 	obs_data_set_default_bool(settings, "enable_focal_blur", false);
 	obs_data_set_default_double(settings, "temporal_smooth_factor", 0);
-	obs_data_set_default_double(settings, "image_similarity_threshold", 35.0);
+	obs_data_set_default_double(settings, "image_similarity_threshold", CHANGE_SIMILARITY_PSNR_DB);
 	obs_data_set_default_bool(settings, "enable_image_similarity", true);
 	obs_data_set_default_double(settings, "blur_focus_point", 0.1);
 	obs_data_set_default_double(settings, "blur_focus_depth", 0.0);
+	obs_data_set_default_int(settings, "max_mask_lag_frames", 0);
+	obs_data_set_default_int(settings, "readback_ring_depth", 3);
+	obs_data_set_default_string(settings, "downscale_mode", DOWNSCALE_OFF);
+	obs_data_set_default_bool(settings, "gpu_mask_upsample", false);
+	obs_data_set_default_bool(settings, "guided_upsample", false);
+	obs_data_set_default_int(settings, "guided_radius", 2);
+	obs_data_set_default_double(settings, "guided_eps", 0.005);
+	obs_data_set_default_string(settings, "blur_mode", BLUR_MODE_KAWASE);
+	obs_data_set_default_bool(settings, "enable_blur_cache", false);
+	obs_data_set_default_bool(settings, "adaptive_cadence", false);
+	obs_data_set_default_int(settings, "min_mask_cadence", 1);
+	obs_data_set_default_int(settings, "max_mask_cadence", 6);
+	obs_data_set_default_double(settings, "inference_budget_ms", 0.0);
+	obs_data_set_default_bool(settings, "enable_mask_propagation", false);
+	obs_data_set_default_bool(settings, "enable_roi_crop", false);
+	obs_data_set_default_double(settings, "blur_cache_full_redraw_fraction", 0.5);
+	obs_data_set_default_int(settings, "postprocess_threads", 0);
+	obs_data_set_default_bool(settings, "batch_inference", false);
+	obs_data_set_default_bool(settings, "enable_stats", false);
+	obs_data_set_default_bool(settings, "verify_mask_postprocess", false);
 }
 
 /*static*/
 obs_properties_t *BgBlur::obs_properties(void *data)
 {
-	UNUSED_PARAMETER(data);
+	FilterData *filterD = (FilterData *)data;
 	obs_properties_t *props = obs_properties_create();
 
+	if (filterD)
+	{
+		bool loading;
+		std::string error;
+
+		{
+			std::lock_guard<std::mutex> lock(filterD->sessionRequestLock);
+			loading = filterD->sessionLoaderBusy;
+			error = filterD->sessionError;
+		}
+
+		if (loading)
+		{
+			obs_properties_add_text(props, "model_status", filterD->sessionState == SESSION_READY ? "Switching the segmentation model..." : "Loading the segmentation model...",
+						OBS_TEXT_INFO);
+		}
+		else if (!error.empty())
+		{
+			obs_property_t *status = obs_properties_add_text(props, "model_status", ("Model failed to load: " + error).c_str(), OBS_TEXT_INFO);
+			obs_property_text_set_info_type(status, OBS_TEXT_INFO_ERROR);
+		}
+	}
+
 	obs_properties_add_int_slider(props, "blur_background", "Blur Amount", 0, 20, 1);
 	obs_properties_add_float_slider(props, "smooth_contour", "Smooth", 0.0, 1.0, 0.01);
 	obs_properties_add_float_slider(props, "temporal_smooth_factor", "Motion Smoothing", 0.0, 0.99, 0.01);
@@ -356,12 +310,74 @@ void BgBlur::obs_update_settings(void *data, obs_data_t *settings)
 
 	filterD->isDisabled = true;
 
+	// Model, provider and threads: a change builds a new session in the background and swaps it in when it is warm
+	const std::string modelSelection = obs_data_get_string(settings, "model_select");
+	const std::string useGPU = obs_data_get_string(settings, "useGPU");
+	const uint32_t numThreads = (uint32_t)std::max<long long>(0, obs_data_get_int(settings, "numThreads"));
+	BgBlurGraphics::requestSession(filterD, modelSelection, useGPU, numThreads);
+
 	filterD->blurBackground = obs_data_get_int(settings, "blur_background");
 	filterD->smoothContour = (float)obs_data_get_double(settings, "smooth_contour");
 	filterD->temporalSmoothFactor = (float)obs_data_get_double(settings, "temporal_smooth_factor");
+	filterD->maxMaskLagFrames = (int)obs_data_get_int(settings, "max_mask_lag_frames");
+	filterD->gpuMaskUpsample = obs_data_get_bool(settings, "gpu_mask_upsample");
+	filterD->guidedUpsample = obs_data_get_bool(settings, "guided_upsample");
+	filterD->guidedRadius = std::max(1, (int)obs_data_get_int(settings, "guided_radius"));
+	filterD->guidedEps = std::max(1e-6f, (float)obs_data_get_double(settings, "guided_eps"));
+	filterD->enableBlurCache = obs_data_get_bool(settings, "enable_blur_cache");
+	filterD->adaptiveCadence = obs_data_get_bool(settings, "adaptive_cadence");
+	filterD->minMaskCadence = (int)obs_data_get_int(settings, "min_mask_cadence");
+	filterD->maxMaskCadence = (int)obs_data_get_int(settings, "max_mask_cadence");
+	filterD->inferenceBudgetMs = (float)obs_data_get_double(settings, "inference_budget_ms");
+	filterD->enableMaskPropagation = obs_data_get_bool(settings, "enable_mask_propagation");
+	filterD->enableRoiCrop = obs_data_get_bool(settings, "enable_roi_crop");
+	filterD->blurCacheFullRedrawFraction = (float)obs_data_get_double(settings, "blur_cache_full_redraw_fraction");
+	filterD->postprocessThreads = postprocessThreadCount((int)obs_data_get_int(settings, "postprocess_threads"), useGPU,
+							      numThreads > 0 ? numThreads : OrtRegistry::instance().intraOpThreads());
+	filterD->batchInference = obs_data_get_bool(settings, "batch_inference");
+	filterD->enableStats = obs_data_get_bool(settings, "enable_stats");
+	filterD->verifyMaskPostprocess = obs_data_get_bool(settings, "verify_mask_postprocess");
+
+	{
+		std::lock_guard<std::mutex> lock(filterD->settingsLock);
+		MaskWorkerSettings &worker = filterD->workerSettings;
+		worker.enableThreshold = filterD->enableThreshold;
+		worker.threshold = filterD->threshold;
+		worker.temporalSmoothFactor = filterD->temporalSmoothFactor;
+		worker.contourFilter = filterD->contourFilter;
+		worker.smoothContour = filterD->smoothContour;
+		worker.feather = filterD->feather;
+		worker.gpuMaskUpsample = filterD->gpuMaskUpsample;
+		worker.guidedUpsample = filterD->guidedUpsample;
+		worker.guidedRadius = filterD->guidedRadius;
+		worker.guidedEps = filterD->guidedEps;
+		worker.maskEveryXFrames = filterD->maskEveryXFrames;
+		worker.adaptiveCadence = filterD->adaptiveCadence;
+		worker.minMaskCadence = filterD->minMaskCadence;
+		worker.maxMaskCadence = filterD->maxMaskCadence;
+		worker.inferenceBudgetMs = filterD->inferenceBudgetMs;
+		worker.enableMaskPropagation = filterD->enableMaskPropagation;
+		worker.enableRoiCrop = filterD->enableRoiCrop;
+		worker.enableImageSimilarity = filterD->enableImageSimilarity;
+		worker.imageSimilarityThreshold = filterD->imageSimilarityThreshold;
+		worker.enableBlurCache = filterD->enableBlurCache;
+		worker.verifyMaskPostprocess = filterD->verifyMaskPostprocess;
+		worker.batchInference = filterD->batchInference;
+	}
+
+	// Settings may change mask buffer shapes, so the next frame is not steady state
+	filterD->scratch.invalidate();
+	filterD->readbackRingDepth = (uint32_t)std::clamp<long long>(obs_data_get_int(settings, "readback_ring_depth"), 1, READBACK_RING_MAX_DEPTH);
 
 	obs_enter_graphics();
 
+	// Read by the render thread, so only swap it while holding the graphics context
+	filterD->downscaleMode = obs_data_get_string(settings, "downscale_mode");
+	filterD->blurMode = obs_data_get_string(settings, "blur_mode");
+
+	// Blur strength, mode and mask sampling all shape the cached blur
+	filterD->blurCacheValid = false;
+
 	gs_effect_destroy(filterD->maskEffect);
 	filterD->maskEffect = gs_effect_create_from_file((std::filesystem::path(obs_get_module_binary_path(obs_current_module())).parent_path() / MASK_EFFECT_PATH).string().c_str(), NULL);
 
@@ -390,12 +406,31 @@ void BgBlur::obs_destroy(void *data)
 	{
 		filterD->isDisabled = true;
 
+		BgBlurGraphics::joinSessionLoad(filterD);
+		BgBlurWorker::stop(filterD);
+
 		obs_enter_graphics();
 		gs_texrender_destroy(filterD->texrender);
+		gs_texrender_destroy(filterD->downscaleTexrender);
+
+		for (gs_texrender_t *levelTexrender : filterD->downscaleLevelTexrenders)
+			gs_texrender_destroy(levelTexrender);
+
+		BgBlurGraphics::destroyStageSurfaces(filterD);
+		gs_texture_destroy(filterD->maskTexture);
+		gs_texrender_destroy(filterD->guidedMaskTexrender);
+		gs_texrender_destroy(filterD->maskDilateTexrenders[0]);
+		gs_texrender_destroy(filterD->maskDilateTexrenders[1]);
+		gs_texrender_destroy(filterD->blurTexrenders[0]);
+		gs_texrender_destroy(filterD->blurTexrenders[1]);
+
+		for (gs_texrender_t *levelTexrender : filterD->dualKawaseTexrenders)
+			gs_texrender_destroy(levelTexrender);
+
+		gs_texrender_destroy(filterD->blurCacheTexrender);
+
+		BgBlurGraphics::destroyGpuTimers(filterD);
 
-		if (filterD->stagesurface)
-			gs_stagesurface_destroy(filterD->stagesurface);
-		
 		gs_effect_destroy(filterD->maskEffect);
 		gs_effect_destroy(filterD->kawaseBlurEffect);
 		obs_leave_graphics();
@@ -14,6 +14,9 @@
 #include <dml_provider_factory.h>
 
 struct FilterData;
+struct FrameGeometry;
+struct MaskVerifyResult;
+struct SessionBuild;
 
 /*static*/
 class BgBlur
@@ -54,8 +57,47 @@ protected:
 class BgBlurGraphics
 {
 public:
-	static int createOrtSession(FilterData *tf);
+	static int createOrtSession(SessionBuild &build);
+	static void requestSession(FilterData *tf, const std::string &modelSelection, const std::string &useGPU, uint32_t numThreads);
+	static void joinSessionLoad(FilterData *tf);
+	static void runSessionLoader(FilterData *tf);
+	static void warmUpSession(FilterData *tf, SessionBuild &build);
+	static void installSession(FilterData *tf, SessionBuild &build);
 	static bool runFilterModelInference(FilterData *tf, const cv::Mat &imageBGRA, cv::Mat &output);
 	static bool getRGBAFromStageSurface(FilterData *tf, uint32_t &width, uint32_t &height);
+	static void destroyStageSurfaces(FilterData *tf);
+	static gs_texture_t *renderGuidedMask(FilterData *tf, uint32_t width, uint32_t height);
+	static gs_texture_t* downscaleForInference(FilterData *tf, uint32_t width, uint32_t height, FrameGeometry &geometry);
+	static bool drawDownscalePass(gs_texrender_t *target, uint32_t width, uint32_t height, gs_texture_t *source, const cv::Rect &sourceRect, const cv::Rect &contentRect);
 	static gs_texture_t* blurBackground(FilterData *tf, uint32_t width, uint32_t height, gs_texture_t *alphaTexture);
+	static gs_texture_t* blurBackgroundDualKawase(FilterData *tf, uint32_t width, uint32_t height, gs_texture_t *alphaTexture);
+	static bool prepareBlurCache(FilterData *tf, uint32_t width, uint32_t height, bool &incremental);
+	static bool drawBlurPass(FilterData *tf, gs_texrender_t *target, gs_texture_t *source, uint32_t width, uint32_t height, const char *technique);
+	static bool updateMaskTexture(FilterData *tf);
+	static float gpuMaskEdgeWidth(FilterData *tf, uint32_t width, uint32_t height);
+	static int gpuMaskDilateRadius(FilterData *tf, uint32_t width, uint32_t height);
+	static gs_texture_t *dilateMask(FilterData *tf, gs_texture_t *mask, uint32_t width, uint32_t height);
+	static void setMaskSamplingParams(FilterData *tf, gs_effect_t *effect, uint32_t width, uint32_t height);
+	static bool beginGpuTimer(FilterData *tf);
+	static void endGpuTimer(FilterData *tf);
+	static void destroyGpuTimers(FilterData *tf);
+};
+
+class BgBlurWorker
+{
+public:
+	static void start(FilterData *tf);
+	static void stop(FilterData *tf);
+	static void submitFrame(FilterData *tf, const cv::Mat &imageBGRA, uint64_t frameId, const FrameGeometry &geometry);
+	static bool fetchMask(FilterData *tf);
+
+private:
+	static void run(FilterData *tf);
+	static void detectBlurCacheChanges(FilterData *tf, bool *dirtyTiles);
+	static void detectBlurCacheMaskChanges(FilterData *tf, const cv::Mat &mask, bool *dirtyTiles);
+	static bool propagateMask(FilterData *tf, cv::Mat &backgroundMask);
+	static int buildMask(FilterData *tf, const cv::Mat &stagedBGRA, uint64_t frameId, const FrameGeometry &stagedGeometry, cv::Mat &backgroundMask);
+	static void pasteNetworkMask(FilterData *tf, const cv::Mat &mask, const FrameGeometry &geometry, const cv::Scalar &outside, cv::Mat &backgroundMask);
+	static void updateInferenceRoi(FilterData *tf, const cv::Mat &mask, const FrameGeometry &geometry);
+	static void recordVerifyResult(FilterData *tf, const MaskVerifyResult &result);
 };
@@ -6,7 +6,10 @@
 #include <wchar.h>
 #include <windows.h>
 
+#include "InferenceScheduler.h"
+#include "ModelCache.h"
 #include "Models.h"
+#include "OrtRegistry.h"
 
 #include "FilterData.h"
 
@@ -14,32 +17,62 @@
 bool BgBlurGraphics::runFilterModelInference(FilterData *tf, const cv::Mat &imageBGRA, cv::Mat &output)
 {
 	// Preprocesses a BGRA video frame, resizes and converts it for the neural network, runs inference
-	//	through the loaded model session, retrieves the output tensor, postprocesses it, and converts the result back to an 8-bit image.
+	//	through the loaded model session, retrieves the output tensor and postprocesses it into a single channel float mask.
+	//	The output may view the session's tensor memory, so it is only valid while modelMutex is held.
 
 	if (tf->session.get() == nullptr || tf->model.get() == nullptr)
 		return false;
 
-	cv::Mat imageRGB;
-	cv::cvtColor(imageBGRA, imageRGB, cv::COLOR_BGRA2RGB);
-
-	// Resize to network input size
+	// Resize to network input size (a no-op when the frame was already downscaled on the GPU)
 	uint32_t inputWidth, inputHeight;
 	tf->model->getNetworkInputSize(tf->inputDims, inputWidth, inputHeight);
 
-	cv::Mat resizedImageRGB;
-	cv::resize(imageRGB, resizedImageRGB, cv::Size(inputWidth, inputHeight));
+	const cv::Mat *networkBGRA = &imageBGRA;
 
-	cv::Mat resizedImage, preprocessedImage;
-	resizedImageRGB.convertTo(resizedImage, CV_32F);
+	if (imageBGRA.cols != (int)inputWidth || imageBGRA.rows != (int)inputHeight)
+	{
+		cv::Mat &resizedBGRA = tf->scratch.get(SCRATCH_RESIZED_BGRA, cv::Size(inputWidth, inputHeight), CV_8UC4);
+		cv::resize(imageBGRA, resizedBGRA, resizedBGRA.size());
+		networkBGRA = &resizedBGRA;
+	}
 
-	tf->model->prepareInputToNetwork(resizedImage, preprocessedImage);
-	tf->model->loadInputToTensor(preprocessedImage, inputWidth, inputHeight, tf->inputTensorValues);
-	tf->model->runNetworkInference(tf->session, tf->inputNames, tf->outputNames, tf->inputTensor, tf->outputTensor);
+	// Single fused pass: swizzle, normalize and lay out straight into the input tensor
+	tf->model->preprocessInput(*networkBGRA, tf->inputTensorValues);
+
+	if (tf->maskSettings.batchInference && tf->batchable)
+	{
+		// Stacked with other instances' frames on the same session; due within one frame interval
+		struct obs_video_info ovi;
+		uint64_t frameIntervalNs = 33333333ULL;
+
+		if (obs_get_video_info(&ovi) && ovi.fps_num > 0)
+			frameIntervalNs = (uint64_t)ovi.fps_den * 1000000000ULL / ovi.fps_num;
+
+		const int batchSize = InferenceScheduler::instance().run(tf->session, tf->sessionId, *tf->sessionRunLock, tf->inputNames[0].get(), tf->outputNames[0].get(), tf->inputTensorValues[0].data(),
+									 tf->inputDims[0], tf->outputTensorValues[0].data(), tf->outputDims[0], os_gettime_ns() + frameIntervalNs);
+		tf->stats.batchedInferences++;
+		tf->stats.batchSizeSum += (uint64_t)batchSize;
+	}
+	else
+	{
+		// Other instances may share the session
+		std::lock_guard<std::mutex> runLock(*tf->sessionRunLock);
+		tf->model->runNetworkInference(tf->session, tf->inputNames, tf->outputNames, tf->inputTensor, tf->outputTensor);
+	}
 
 	cv::Mat outputImage = tf->model->getNetworkOutput(tf->outputDims, tf->outputTensorValues);
 	tf->model->assignOutputToInput(tf->outputTensorValues, tf->inputTensorValues);
-	tf->model->postprocessOutput(outputImage);
-	outputImage.convertTo(output, CV_8U, 255.0);
+	tf->model->postprocessOutput(outputImage, tf->scratch);
+
+	// The mask post-processing reads the float output directly, conversion to 8-bit is fused into its first pass
+	if (outputImage.channels() > 1)
+	{
+		cv::Mat &channel = tf->scratch.get(SCRATCH_MODEL_CHANNEL, outputImage.size(), CV_32FC1);
+		cv::extractChannel(outputImage, channel, 0);
+		outputImage = channel;
+	}
+
+	output = outputImage;
 	return true;
 }
 
@@ -47,7 +80,7 @@ bool BgBlurGraphics::runFilterModelInference(FilterData *tf, const cv::Mat &imag
 bool BgBlurGraphics::getRGBAFromStageSurface(FilterData *tf, uint32_t &width, uint32_t &height)
 {
 	// Captures a live video frame from a source, renders it to a texture, transfers it onto
-	//	a staging surface, maps it into CPU-accessible memory, then it wraps the pixel buffer into an OpenCV cv::Mat (BGRA format)
+	//	a staging surface, maps it into CPU-accessible memory, then it submits the pixel buffer to the mask worker as an OpenCV cv::Mat (BGRA format)
 
 	if (!obs_source_enabled(tf->source))
 		return false;
@@ -78,46 +111,395 @@ bool BgBlurGraphics::getRGBAFromStageSurface(FilterData *tf, uint32_t &width, ui
 	gs_blend_state_pop();
 	gs_texrender_end(tf->texrender);
 
-	if (tf->stagesurface)
+	// The full-res texrender stays around for compositing, only the (optionally downscaled) copy is read back
+	FrameGeometry geometry;
+	gs_texture_t *stageTexture = downscaleForInference(tf, width, height, geometry);
+
+	if (!stageTexture)
+		return false;
+
+	const uint32_t stageWidth = gs_texture_get_width(stageTexture);
+	const uint32_t stageHeight = gs_texture_get_height(stageTexture);
+
+	// Stage into a ring of surfaces and map the one staged (ring depth - 1) frames ago, so the GPU->CPU copy
+	//	overlaps rendering instead of stalling on it. Rebuild the ring on resolution or depth change.
+	const uint32_t ringDepth = std::clamp<uint32_t>(tf->readbackRingDepth, 1, READBACK_RING_MAX_DEPTH);
+
+	if (tf->stagesurfaces[0])
 	{
-		uint32_t stagesurf_width = gs_stagesurface_get_width(tf->stagesurface);
-		uint32_t stagesurf_height = gs_stagesurface_get_height(tf->stagesurface);
+		uint32_t stagesurf_width = gs_stagesurface_get_width(tf->stagesurfaces[0]);
+		uint32_t stagesurf_height = gs_stagesurface_get_height(tf->stagesurfaces[0]);
 
-		if (stagesurf_width != width || stagesurf_height != height)
+		if (stagesurf_width != stageWidth || stagesurf_height != stageHeight || tf->stagesurfaceCount != ringDepth)
+			destroyStageSurfaces(tf);
+	}
+
+	if (!tf->stagesurfaces[0])
+	{
+		for (uint32_t i = 0; i < ringDepth; ++i)
 		{
-			gs_stagesurface_destroy(tf->stagesurface);
-			tf->stagesurface = nullptr;
+			tf->stagesurfaces[i] = gs_stagesurface_create(stageWidth, stageHeight, GS_BGRA);
+			tf->stagesurfaceFrameIds[i] = 0;
 		}
+
+		tf->stagesurfaceCount = ringDepth;
+		tf->stagesurfaceIndex = 0;
 	}
 
-	if (!tf->stagesurface)
-		tf->stagesurface = gs_stagesurface_create(width, height, GS_BGRA);
+	const uint32_t writeIndex = tf->stagesurfaceIndex;
+	gs_stage_texture(tf->stagesurfaces[writeIndex], stageTexture);
+	tf->stagesurfaceFrameIds[writeIndex] = ++tf->frameCounter;
+	tf->stagesurfaceGeometry[writeIndex] = geometry;
+	tf->stagesurfaceIndex = (writeIndex + 1) % ringDepth;
+
+	// The next slot is the oldest one; with a depth of 1 it is the surface we just staged
+	const uint32_t readIndex = tf->stagesurfaceIndex;
 
-	gs_stage_texture(tf->stagesurface, gs_texrender_get_texture(tf->texrender));
+	// Ring is still filling up, composite with the current mask
+	if (tf->stagesurfaceFrameIds[readIndex] == 0)
+		return true;
 
 	uint8_t *video_data;
 	uint32_t linesize;
 
-	if (!gs_stagesurface_map(tf->stagesurface, &video_data, &linesize))
+	if (!gs_stagesurface_map(tf->stagesurfaces[readIndex], &video_data, &linesize))
 		return false;
 
+	// Hand a copy to the mask worker; the mapped memory is only valid until unmap
+	BgBlurWorker::submitFrame(tf, cv::Mat(stageHeight, stageWidth, CV_8UC4, video_data, linesize), tf->stagesurfaceFrameIds[readIndex], tf->stagesurfaceGeometry[readIndex]);
+
+	tf->stats.stagedFrames++;
+	tf->stats.stagedBytes += (uint64_t)stageHeight * linesize;
+
+	gs_stagesurface_unmap(tf->stagesurfaces[readIndex]);
+	return true;
+}
+
+/*static*/
+void BgBlurGraphics::destroyStageSurfaces(FilterData *tf)
+{
+	for (uint32_t i = 0; i < READBACK_RING_MAX_DEPTH; ++i)
+	{
+		if (tf->stagesurfaces[i])
+			gs_stagesurface_destroy(tf->stagesurfaces[i]);
+
+		tf->stagesurfaces[i] = nullptr;
+		tf->stagesurfaceFrameIds[i] = 0;
+	}
+
+	tf->stagesurfaceCount = 0;
+	tf->stagesurfaceIndex = 0;
+}
+
+/*static*/
+gs_texture_t* BgBlurGraphics::downscaleForInference(FilterData *tf, uint32_t width, uint32_t height, FrameGeometry &geometry)
+{
+	// Renders the captured frame into a render target the size of the network input, so only those pixels are
+	//	read back instead of the full frame. Stretch fills the target, letterbox keeps the aspect ratio and pads with black.
+
+	const cv::Rect frameRect(0, 0, (int)width, (int)height);
+	geometry.frameSize = frameRect.size();
+	geometry.roiRect = frameRect;
+	geometry.contentRect = frameRect;
+
+	// With an inference ROI only that part of the frame goes to the network. The full-resolution path below
+	//	stages the whole frame and the worker crops it.
+	if (tf->enableRoiCrop)
 	{
 		std::lock_guard<std::mutex> lock(tf->inputBGRALock);
-		tf->inputBGRA = cv::Mat(height, width, CV_8UC4, video_data, linesize);
+		const cv::Rect roi = tf->inferenceRoi & frameRect;
+
+		if (!roi.empty())
+			geometry.roiRect = roi;
+	}
+
+	const cv::Rect &roi = geometry.roiRect;
+	const uint32_t netWidth = tf->networkWidth;
+	const uint32_t netHeight = tf->networkHeight;
+
+	if (tf->downscaleMode == DOWNSCALE_OFF || netWidth == 0 || netHeight == 0 || (netWidth >= width && netHeight >= height))
+		return gs_texrender_get_texture(tf->texrender);
+
+	uint32_t contentWidth = netWidth;
+	uint32_t contentHeight = netHeight;
+
+	if (tf->downscaleMode == DOWNSCALE_LETTERBOX)
+	{
+		const float scale = std::min((float)netWidth / (float)roi.width, (float)netHeight / (float)roi.height);
+		contentWidth = std::clamp<uint32_t>((uint32_t)std::lround(roi.width * scale), 1, netWidth);
+		contentHeight = std::clamp<uint32_t>((uint32_t)std::lround(roi.height * scale), 1, netHeight);
+	}
+
+	const uint32_t offsetX = (netWidth - contentWidth) / 2;
+	const uint32_t offsetY = (netHeight - contentHeight) / 2;
+
+	// One bilinear pass from 1080p / 4K to network size would skip most source texels and alias. Halving passes first,
+	//	each a 2x2 box (bilinear taps land between four texels), until one more would undershoot the content size;
+	//	that keeps the network input close to the CPU path's INTER_AREA resize.
+	gs_texture_t *source = gs_texrender_get_texture(tf->texrender);
+	cv::Rect sourceRect = roi;
+	uint32_t level = 0;
+
+	while (level < DOWNSCALE_MAX_LEVELS && (uint32_t)sourceRect.width / 2 >= contentWidth && (uint32_t)sourceRect.height / 2 >= contentHeight)
+	{
+		const uint32_t levelWidth = (uint32_t)sourceRect.width / 2;
+		const uint32_t levelHeight = (uint32_t)sourceRect.height / 2;
+
+		if (!tf->downscaleLevelTexrenders[level])
+			tf->downscaleLevelTexrenders[level] = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+		if (!drawDownscalePass(tf->downscaleLevelTexrenders[level], levelWidth, levelHeight, source, sourceRect, cv::Rect(0, 0, (int)levelWidth, (int)levelHeight)))
+			return nullptr;
+
+		source = gs_texrender_get_texture(tf->downscaleLevelTexrenders[level]);
+		sourceRect = cv::Rect(0, 0, (int)levelWidth, (int)levelHeight);
+		++level;
+	}
+
+	if (!tf->downscaleTexrender)
+		tf->downscaleTexrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+	const cv::Rect contentRect((int)offsetX, (int)offsetY, (int)contentWidth, (int)contentHeight);
+
+	if (!drawDownscalePass(tf->downscaleTexrender, netWidth, netHeight, source, sourceRect, contentRect))
+		return nullptr;
+
+	geometry.contentRect = contentRect;
+	return gs_texrender_get_texture(tf->downscaleTexrender);
+}
+
+/*static*/
+bool BgBlurGraphics::drawDownscalePass(gs_texrender_t *target, uint32_t width, uint32_t height, gs_texture_t *source, const cv::Rect &sourceRect,
+				       const cv::Rect &contentRect)
+{
+	// Draws sourceRect of source into contentRect of a width x height target, clearing the rest to black
+
+	gs_texrender_reset(target);
+
+	if (!gs_texrender_begin(target, width, height))
+		return false;
+
+	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), source);
+
+	struct vec4 background;
+	vec4_zero(&background);
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height), -100.0f, 100.0f);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	gs_matrix_push();
+	gs_matrix_translate3f(static_cast<float>(contentRect.x), static_cast<float>(contentRect.y), 0.0f);
+
+	if (sourceRect == cv::Rect(0, 0, (int)gs_texture_get_width(source), (int)gs_texture_get_height(source)))
+	{
+		while (gs_effect_loop(effect, "Draw"))
+			gs_draw_sprite(source, 0, (uint32_t)contentRect.width, (uint32_t)contentRect.height);
+	}
+	else
+	{
+		// Draw just the source rect texels, scaled to the content size
+		gs_matrix_scale3f((float)contentRect.width / (float)sourceRect.width, (float)contentRect.height / (float)sourceRect.height, 1.0f);
+
+		while (gs_effect_loop(effect, "Draw"))
+			gs_draw_sprite_subregion(source, 0, (uint32_t)sourceRect.x, (uint32_t)sourceRect.y, (uint32_t)sourceRect.width, (uint32_t)sourceRect.height);
+	}
+
+	gs_matrix_pop();
+	gs_blend_state_pop();
+	gs_texrender_end(target);
+	return true;
+}
+
+/*static*/
+bool BgBlurGraphics::updateMaskTexture(FilterData *tf)
+{
+	const cv::Mat &mask = tf->backgroundMask;
+
+	// 8-bit mask, or guided upsampling coefficients (a, b)
+	const gs_color_format format = mask.type() == CV_32FC2 ? GS_RG32F : GS_R8;
+
+	if (tf->maskTexture && (gs_texture_get_width(tf->maskTexture) != (uint32_t)mask.cols || gs_texture_get_height(tf->maskTexture) != (uint32_t)mask.rows ||
+				gs_texture_get_color_format(tf->maskTexture) != format))
+	{
+		gs_texture_destroy(tf->maskTexture);
+		tf->maskTexture = nullptr;
+	}
+
+	if (!tf->maskTexture)
+	{
+		tf->maskTexture = gs_texture_create(mask.cols, mask.rows, format, 1, nullptr, GS_DYNAMIC);
+		tf->maskTextureStale = true;
+	}
+
+	if (!tf->maskTexture)
+		return false;
+
+	if (tf->maskTextureStale)
+	{
+		gs_texture_set_image(tf->maskTexture, mask.data, (uint32_t)mask.step, false);
+		tf->maskTextureStale = false;
 	}
 
-	gs_stagesurface_unmap(tf->stagesurface);
 	return true;
 }
 
+/*static*/
+gs_texture_t *BgBlurGraphics::renderGuidedMask(FilterData *tf, uint32_t width, uint32_t height)
+{
+	// Fast guided filter apply at output resolution: q = a * luma + b per pixel, with the network-resolution
+	//	coefficients in maskTexture bilinearly sampled and the captured source frame as the guide
+
+	gs_texture_t *guideTexture = gs_texrender_get_texture(tf->texrender);
+
+	if (!guideTexture || !tf->maskTexture)
+		return nullptr;
+
+	if (!tf->guidedMaskTexrender)
+		tf->guidedMaskTexrender = gs_texrender_create(GS_R8, GS_ZS_NONE);
+
+	gs_texrender_reset(tf->guidedMaskTexrender);
+
+	if (!gs_texrender_begin(tf->guidedMaskTexrender, width, height))
+		return nullptr;
+
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	gs_effect_t *effect = tf->maskEffect;
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), guideTexture);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "guideCoefficients"), tf->maskTexture);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "guidedEdgeWidth"), tf->enableThreshold ? GUIDED_MASK_EDGE_WIDTH : 0.0f);
+
+	while (gs_effect_loop(effect, "GuidedUpsample"))
+		gs_draw_sprite(nullptr, 0, width, height);
+
+	gs_blend_state_pop();
+	gs_texrender_end(tf->guidedMaskTexrender);
+
+	return gs_texrender_get_texture(tf->guidedMaskTexrender);
+}
+
+/*static*/
+float BgBlurGraphics::gpuMaskEdgeWidth(FilterData *tf, uint32_t width, uint32_t height)
+{
+	// When the mask is uploaded at network resolution the effects upsample it: bilinear sampling, then the re-binarize
+	//	the CPU path does at full resolution, with about one output pixel of anti-aliasing. Zero leaves sampling untouched.
+	const cv::Mat &mask = tf->backgroundMask;
+	const bool guided = mask.type() == CV_32FC2; // already resolved to a full-resolution mask by renderGuidedMask
+	const bool upsampled = tf->gpuMaskUpsample && tf->enableThreshold && (mask.cols != (int)width || mask.rows != (int)height);
+
+	if (!upsampled || guided || tf->smoothContour <= 0.0f)
+		return 0.0f;
+
+	return std::min(0.5f, 0.5f * (float)mask.cols / (float)width);
+}
+
+/*static*/
+int BgBlurGraphics::gpuMaskDilateRadius(FilterData *tf, uint32_t width, uint32_t height)
+{
+	// Feather dilation of a mask upsampled in the effects, in output pixels; 0 when the CPU path already did it
+	const cv::Mat &mask = tf->backgroundMask;
+	const bool guided = mask.type() == CV_32FC2;
+	const bool upsampled = tf->gpuMaskUpsample && tf->enableThreshold && (mask.cols != (int)width || mask.rows != (int)height);
+
+	if (!(upsampled || guided) || tf->feather <= 0.0f)
+		return 0;
+
+	return std::min(featherDilateIterations(tf->feather), MASK_DILATE_MAX_RADIUS);
+}
+
+/*static*/
+gs_texture_t *BgBlurGraphics::dilateMask(FilterData *tf, gs_texture_t *mask, uint32_t width, uint32_t height)
+{
+	// The CPU path's square max filter as two separable passes at output resolution, horizontal then vertical. The
+	//	first re-binarizes while it samples the network-resolution mask, so the effects read the result as is.
+
+	tf->maskDilatedOnGpu = false;
+
+	const int radius = gpuMaskDilateRadius(tf, width, height);
+
+	if (radius == 0)
+		return mask;
+
+	gs_effect_t *effect = tf->maskEffect;
+	gs_texture_t *source = mask;
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		if (!tf->maskDilateTexrenders[pass])
+			tf->maskDilateTexrenders[pass] = gs_texrender_create(GS_R8, GS_ZS_NONE);
+
+		gs_texrender_reset(tf->maskDilateTexrenders[pass]);
+
+		if (!gs_texrender_begin(tf->maskDilateTexrenders[pass], width, height))
+			return mask;
+
+		struct vec2 step;
+		vec2_set(&step, pass == 0 ? 1.0f / (float)width : 0.0f, pass == 0 ? 0.0f : 1.0f / (float)height);
+
+		gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+		gs_blend_state_push();
+		gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+		gs_effect_set_texture(gs_effect_get_param_by_name(effect, "dilateSource"), source);
+		gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "dilateStep"), &step);
+		gs_effect_set_int(gs_effect_get_param_by_name(effect, "dilateRadius"), radius);
+		gs_effect_set_float(gs_effect_get_param_by_name(effect, "maskEdgeWidth"), pass == 0 ? gpuMaskEdgeWidth(tf, width, height) : 0.0f);
+
+		while (gs_effect_loop(effect, "MaskDilate"))
+			gs_draw_sprite(nullptr, 0, width, height);
+
+		gs_blend_state_pop();
+		gs_texrender_end(tf->maskDilateTexrenders[pass]);
+
+		source = gs_texrender_get_texture(tf->maskDilateTexrenders[pass]);
+	}
+
+	tf->maskDilatedOnGpu = true;
+	return source;
+}
+
+/*static*/
+void BgBlurGraphics::setMaskSamplingParams(FilterData *tf, gs_effect_t *effect, uint32_t width, uint32_t height)
+{
+	// A mask dilated by dilateMask this frame is already re-binarized at full resolution
+	const float edgeWidth = tf->maskDilatedOnGpu ? 0.0f : gpuMaskEdgeWidth(tf, width, height);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "maskEdgeWidth"), edgeWidth);
+}
+
 /*static*/
 gs_texture_t* BgBlurGraphics::blurBackground(FilterData *tf, uint32_t width, uint32_t height, gs_texture_t *alphaTexture)
 {
 	if (tf->blurBackground == 0 || !tf->kawaseBlurEffect)
 		return nullptr;
 
-	gs_texture_t *blurredTexture = gs_texture_create(width, height, GS_BGRA, 1, nullptr, 0);
-	gs_copy_texture(blurredTexture, gs_texrender_get_texture(tf->texrender));
+	if (tf->blurMode == BLUR_MODE_DUAL_KAWASE)
+	{
+		const bool timedDual = beginGpuTimer(tf);
+		gs_texture_t *blurred = blurBackgroundDualKawase(tf, width, height, alphaTexture);
+
+		if (timedDual)
+			endGpuTimer(tf);
+
+		return blurred;
+	}
+
+	// Cached mode re-blurs only the dirty tiles (scissored) into the ping-pong pair, then copies them into the cache
+	bool incremental = false;
+
+	if (tf->enableBlurCache && prepareBlurCache(tf, width, height, incremental))
+		return gs_texrender_get_texture(tf->blurCacheTexrender);
+
+	const bool cached = tf->enableBlurCache && tf->blurCacheValid;
+
+	// Ping-pong between two texrenders owned by the blur, so the capture texrender stays intact and no copy pass is needed
+	for (gs_texrender_t *&blurTexrender : tf->blurTexrenders)
+		if (!blurTexrender)
+			blurTexrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+	gs_texture_t *source = gs_texrender_get_texture(tf->texrender);
 	gs_eparam_t *image = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "image");
 	gs_eparam_t *focalmask = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "focalmask");
 	gs_eparam_t *xOffset = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "xOffset");
@@ -127,17 +509,34 @@ gs_texture_t* BgBlurGraphics::blurBackground(FilterData *tf, uint32_t width, uin
 	gs_eparam_t *blurFocusPointParam = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "blurFocusPoint");
 	gs_eparam_t *blurFocusDepthParam = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "blurFocusDepth");
 
+	setMaskSamplingParams(tf, tf->kawaseBlurEffect, width, height);
+
+	if (cached)
+		gs_effect_set_texture(gs_effect_get_param_by_name(tf->kawaseBlurEffect, "cachedBlur"), gs_texrender_get_texture(tf->blurCacheTexrender));
+
+	// Pass i reaches i + 2 pixels (offset i + 0.5 plus the bilinear footprint). Pixels up to the total reach outside a
+	//	dirty tile read changed input too, so the cache takes the dirty rects grown by it. Scissored passes must cover
+	//	what every later pass reads, so pass i draws them grown by that plus the reach of passes i + 1 .. N - 1.
+	int totalReach = 0;
+	for (int i = 0; i < (int)tf->blurBackground; i++)
+		totalReach += i + 2;
+
+	int scissorGrowth = 2 * totalReach - 2;
+
+	const bool timed = beginGpuTimer(tf);
+
 	for (int i = 0; i < (int)tf->blurBackground; i++)
 	{
-		gs_texrender_reset(tf->texrender);
+		gs_texrender_t *target = tf->blurTexrenders[i & 1];
+		gs_texrender_reset(target);
 
-		if (!gs_texrender_begin(tf->texrender, width, height))
+		if (!gs_texrender_begin(target, width, height))
 		{
 			blog(LOG_INFO, "BgBlurGraphics::blurBackground - Could not open background blur texrender!");
-			return blurredTexture;
+			break;
 		}
 
-		gs_effect_set_texture(image, blurredTexture);
+		gs_effect_set_texture(image, source);
 		gs_effect_set_texture(focalmask, alphaTexture);
 		gs_effect_set_float(xOffset, ((float)i + 0.5f) / (float)width);
 		gs_effect_set_float(yOffset, ((float)i + 0.5f) / (float)height);
@@ -148,28 +547,317 @@ gs_texture_t* BgBlurGraphics::blurBackground(FilterData *tf, uint32_t width, uin
 
 		struct vec4 background;
 		vec4_zero(&background);
-		gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+
+		// Clears ignore the scissor, and outside the dirty rects the previous contents are never read anyway
+		if (!incremental)
+			gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+
 		gs_ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height), -100.0f, 100.0f);
 		gs_blend_state_push();
 		gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
 
-		const char *blur_type = "Draw";
+		const char *blur_type = cached ? "DrawCached" : "Draw";
 
-		while (gs_effect_loop(tf->kawaseBlurEffect, blur_type))
-			gs_draw_sprite(blurredTexture, 0, width, height);
+		if (incremental)
+		{
+			for (const gs_rect &rect : tf->blurCacheRects)
+			{
+				gs_rect grown;
+				grown.x = std::max(0, rect.x - scissorGrowth);
+				grown.y = std::max(0, rect.y - scissorGrowth);
+				grown.cx = std::min((int)width, rect.x + rect.cx + scissorGrowth) - grown.x;
+				grown.cy = std::min((int)height, rect.y + rect.cy + scissorGrowth) - grown.y;
+				gs_set_scissor_rect(&grown);
+
+				while (gs_effect_loop(tf->kawaseBlurEffect, blur_type))
+					gs_draw_sprite(source, 0, width, height);
+			}
+
+			gs_set_scissor_rect(nullptr);
+		}
+		else
+		{
+			while (gs_effect_loop(tf->kawaseBlurEffect, blur_type))
+				gs_draw_sprite(source, 0, width, height);
+		}
 		
 		gs_blend_state_pop();
-		gs_texrender_end(tf->texrender);
-		gs_copy_texture(blurredTexture, gs_texrender_get_texture(tf->texrender));
+		gs_texrender_end(target);
+		source = gs_texrender_get_texture(target);
+
+		if (i + 1 < (int)tf->blurBackground)
+			scissorGrowth -= i + 3;
+	}
+
+	if (cached)
+	{
+		gs_texture_t *cacheTexture = gs_texrender_get_texture(tf->blurCacheTexrender);
+
+		if (incremental)
+		{
+			for (const gs_rect &rect : tf->blurCacheRects)
+			{
+				const int x0 = std::max(0, rect.x - totalReach);
+				const int y0 = std::max(0, rect.y - totalReach);
+				const int x1 = std::min((int)width, rect.x + rect.cx + totalReach);
+				const int y1 = std::min((int)height, rect.y + rect.cy + totalReach);
+				gs_copy_texture_region(cacheTexture, x0, y0, source, x0, y0, x1 - x0, y1 - y0);
+			}
+		}
+		else
+		{
+			gs_copy_texture(cacheTexture, source);
+		}
+
+		source = cacheTexture;
+	}
+
+	if (timed)
+		endGpuTimer(tf);
+
+	return source;
+}
+
+/*static*/
+bool BgBlurGraphics::prepareBlurCache(FilterData *tf, uint32_t width, uint32_t height, bool &incremental)
+{
+	// Returns true when the cached blur is current and can be used as is. Otherwise fills tf->blurCacheRects with the
+	//	dirty tiles (one rect per run of dirty tiles in a tile row) and sets incremental, or resets the cache for a full redraw.
+
+	// Dirty tiles arrive in tf->blurCacheDirty together with their mask, see BgBlurWorker::fetchMask
+	const cv::Size size((int)width, (int)height);
+	int dirtyCount = 0;
+
+	for (bool dirty : tf->blurCacheDirty)
+		dirtyCount += dirty ? 1 : 0;
+
+	const bool valid = tf->blurCacheValid && tf->blurCacheTexrender && tf->blurCacheSize == size;
+
+	if (valid && dirtyCount == 0)
+		return true;
+
+	incremental = valid && (float)dirtyCount <= tf->blurCacheFullRedrawFraction * (float)BLUR_CACHE_TILE_COUNT;
+	tf->blurCacheRects.clear();
+
+	if (incremental)
+	{
+		for (int ty = 0; ty < BLUR_CACHE_TILES_Y; ++ty)
+		{
+			const int y0 = ty * (int)height / BLUR_CACHE_TILES_Y;
+			const int y1 = (ty + 1) * (int)height / BLUR_CACHE_TILES_Y;
+
+			for (int tx = 0; tx < BLUR_CACHE_TILES_X; ++tx)
+			{
+				if (!tf->blurCacheDirty[ty * BLUR_CACHE_TILES_X + tx])
+					continue;
+
+				const int runStart = tx;
+				while (tx + 1 < BLUR_CACHE_TILES_X && tf->blurCacheDirty[ty * BLUR_CACHE_TILES_X + tx + 1])
+					++tx;
+
+				gs_rect rect;
+				rect.x = runStart * (int)width / BLUR_CACHE_TILES_X;
+				rect.y = y0;
+				rect.cx = (tx + 1) * (int)width / BLUR_CACHE_TILES_X - rect.x;
+				rect.cy = y1 - y0;
+
+				if (rect.cx > 0 && rect.cy > 0)
+					tf->blurCacheRects.push_back(rect);
+			}
+		}
+
+		tf->stats.blurCacheTilesRedrawn += dirtyCount;
+	}
+	else
+	{
+		if (!tf->blurCacheTexrender)
+			tf->blurCacheTexrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+		// Start from an empty cache: alpha 0 everywhere means no background has been seen yet
+		gs_texrender_reset(tf->blurCacheTexrender);
+
+		if (!gs_texrender_begin(tf->blurCacheTexrender, width, height))
+		{
+			blog(LOG_INFO, "BgBlurGraphics::prepareBlurCache - Could not open blur cache texrender!");
+			tf->blurCacheValid = false;
+			return false;
+		}
+
+		struct vec4 background;
+		vec4_zero(&background);
+		gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+		gs_texrender_end(tf->blurCacheTexrender);
+
+		tf->blurCacheValid = true;
+		tf->blurCacheSize = size;
+		tf->stats.blurCacheFullRedraws++;
+	}
+
+	std::fill(std::begin(tf->blurCacheDirty), std::end(tf->blurCacheDirty), false);
+	return false;
+}
+
+/*static*/
+gs_texture_t* BgBlurGraphics::blurBackgroundDualKawase(FilterData *tf, uint32_t width, uint32_t height, gs_texture_t *alphaTexture)
+{
+	// Dual filter pyramid: halve the resolution DUAL_KAWASE_MAX_LEVELS times at most, then double it back up. The blur
+	//	strength picks the pyramid depth and, within a depth, the tap offset, so 20 costs ~2 full-res passes worth of fill.
+
+	const int strength = (int)tf->blurBackground - 1;
+	const int depth = std::clamp(1 + strength / 4, 1, DUAL_KAWASE_MAX_LEVELS);
+	const float offset = 1.0f + (float)(strength % 4) * 0.5f;
+
+	gs_texture_t *base = gs_texrender_get_texture(tf->texrender);
+	gs_effect_set_texture(gs_effect_get_param_by_name(tf->kawaseBlurEffect, "focalmask"), alphaTexture);
+	gs_effect_set_texture(gs_effect_get_param_by_name(tf->kawaseBlurEffect, "baseImage"), base);
+	gs_eparam_t *xOffset = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "xOffset");
+	gs_eparam_t *yOffset = gs_effect_get_param_by_name(tf->kawaseBlurEffect, "yOffset");
+
+	setMaskSamplingParams(tf, tf->kawaseBlurEffect, width, height);
+
+	uint32_t levelWidth[DUAL_KAWASE_MAX_LEVELS + 1];
+	uint32_t levelHeight[DUAL_KAWASE_MAX_LEVELS + 1];
+	levelWidth[0] = width;
+	levelHeight[0] = height;
+
+	gs_texture_t *source = base;
+
+	for (int level = 1; level <= depth; ++level)
+	{
+		levelWidth[level] = std::max<uint32_t>(1, width >> level);
+		levelHeight[level] = std::max<uint32_t>(1, height >> level);
+
+		gs_texrender_t *&target = tf->dualKawaseTexrenders[level - 1];
+		if (!target)
+			target = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+		// Half a texel of the level being read, scaled by the strength offset
+		gs_effect_set_float(xOffset, offset * 0.5f / (float)levelWidth[level - 1]);
+		gs_effect_set_float(yOffset, offset * 0.5f / (float)levelHeight[level - 1]);
+
+		if (!drawBlurPass(tf, target, source, levelWidth[level], levelHeight[level], "DrawDualDown"))
+			return base;
+
+		source = gs_texrender_get_texture(target);
+	}
+
+	// Upsample back into the level above; the last pass lands in a full-res blur target
+	for (int level = depth - 1; level >= 0; --level)
+	{
+		gs_texrender_t *target = level > 0 ? tf->dualKawaseTexrenders[level - 1] : tf->blurTexrenders[0];
+
+		if (!target)
+			target = tf->blurTexrenders[0] = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+
+		gs_effect_set_float(xOffset, offset * 0.5f / (float)levelWidth[level + 1]);
+		gs_effect_set_float(yOffset, offset * 0.5f / (float)levelHeight[level + 1]);
+
+		if (!drawBlurPass(tf, target, source, levelWidth[level], levelHeight[level], level > 0 ? "DrawDualUp" : "DrawDualUpFinal"))
+			return base;
+
+		source = gs_texrender_get_texture(target);
+	}
+
+	return source;
+}
+
+/*static*/
+bool BgBlurGraphics::drawBlurPass(FilterData *tf, gs_texrender_t *target, gs_texture_t *source, uint32_t width, uint32_t height, const char *technique)
+{
+	gs_texrender_reset(target);
+
+	if (!gs_texrender_begin(target, width, height))
+	{
+		blog(LOG_INFO, "BgBlurGraphics::drawBlurPass - Could not open background blur texrender!");
+		return false;
 	}
 
-	return blurredTexture;
+	gs_effect_set_texture(gs_effect_get_param_by_name(tf->kawaseBlurEffect, "image"), source);
+
+	struct vec4 background;
+	vec4_zero(&background);
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height), -100.0f, 100.0f);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	while (gs_effect_loop(tf->kawaseBlurEffect, technique))
+		gs_draw_sprite(source, 0, width, height);
+
+	gs_blend_state_pop();
+	gs_texrender_end(target);
+	return true;
+}
+
+/*static*/
+bool BgBlurGraphics::beginGpuTimer(FilterData *tf)
+{
+	// GPU timestamp queries resolve a few frames later, so cycle through a small ring and collect whichever slot
+	//	comes around again. A slot whose result isn't ready yet is skipped for this frame rather than waited on.
+
+	GpuTimerSlot &slot = tf->blurTimers[tf->blurTimerIndex];
+
+	if (!slot.range)
+	{
+		slot.range = gs_timer_range_create();
+		slot.timer = gs_timer_create();
+	}
+
+	if (!slot.range || !slot.timer)
+		return false;
+
+	if (slot.pending)
+	{
+		bool disjoint = false;
+		uint64_t frequency = 0;
+		uint64_t ticks = 0;
+
+		if (!gs_timer_range_get_data(slot.range, &disjoint, &frequency) || !gs_timer_get_data(slot.timer, &ticks))
+			return false;
+
+		slot.pending = false;
+
+		if (!disjoint && frequency > 0)
+		{
+			tf->stats.blurGpuNs += (uint64_t)((double)ticks * 1000000000.0 / (double)frequency);
+			tf->stats.blurGpuSamples++;
+		}
+	}
+
+	gs_timer_range_begin(slot.range);
+	gs_timer_begin(slot.timer);
+	return true;
+}
+
+/*static*/
+void BgBlurGraphics::endGpuTimer(FilterData *tf)
+{
+	GpuTimerSlot &slot = tf->blurTimers[tf->blurTimerIndex];
+	gs_timer_end(slot.timer);
+	gs_timer_range_end(slot.range);
+	slot.pending = true;
+	tf->blurTimerIndex = (tf->blurTimerIndex + 1) % GPU_TIMER_RING_DEPTH;
+}
+
+/*static*/
+void BgBlurGraphics::destroyGpuTimers(FilterData *tf)
+{
+	for (GpuTimerSlot &slot : tf->blurTimers)
+	{
+		if (slot.timer)
+			gs_timer_destroy(slot.timer);
+
+		if (slot.range)
+			gs_timer_range_destroy(slot.range);
+
+		slot = GpuTimerSlot();
+	}
 }
 
 /*static*/
-int BgBlurGraphics::createOrtSession(FilterData *tf)
+int BgBlurGraphics::createOrtSession(SessionBuild &build)
 {
-	if (tf->model.get() == nullptr)
+	if (build.model.get() == nullptr)
 	{
 		blog(LOG_ERROR, "BgBlur::createOrtSession null model");
 		return OBS_BGREMOVAL_ORT_SESSION_ERROR_INVALID_MODEL;
@@ -178,30 +866,53 @@ int BgBlurGraphics::createOrtSession(FilterData *tf)
 	Ort::SessionOptions sessionOptions;
 	sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
 
-	if (tf->useGPU != USEGPU_CPU)
+	// CPU tensors come from the registry's shared arena
+	sessionOptions.AddConfigEntry("session.use_env_allocators", "1");
+
+	// Everything that shapes the session goes into its cache key
+	std::string optionsKey = build.useGPU + ";opt=all";
+
+	if (build.useGPU != USEGPU_CPU)
 	{
 		sessionOptions.DisableMemPattern();
 		sessionOptions.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+		optionsKey += ";nomempattern;sequential";
+	}
+
+	if (build.useGPU == USEGPU_CPU && build.numThreads > 0)
+	{
+		// An explicit thread count gets the session its own pools
+		sessionOptions.SetInterOpNumThreads(build.numThreads);
+		sessionOptions.SetIntraOpNumThreads(build.numThreads);
+		optionsKey += ";threads=" + std::to_string(build.numThreads);
 	}
 	else
 	{
-		sessionOptions.SetInterOpNumThreads(tf->numThreads);
-		sessionOptions.SetIntraOpNumThreads(tf->numThreads);
+		sessionOptions.DisablePerSessionThreads();
 	}
 
-	auto modelFilepath = (std::filesystem::path(obs_get_module_binary_path(obs_current_module())).parent_path() / tf->modelSelection);
+	auto modelFilepath = (std::filesystem::path(obs_get_module_binary_path(obs_current_module())).parent_path() / build.modelSelection);
 
 	if (!std::filesystem::exists(modelFilepath))
 	{
-		blog(LOG_ERROR, "tf->modelSelection not found at %s", modelFilepath.string().c_str());
+		blog(LOG_ERROR, "Model %s not found at %s", build.modelSelection.c_str(), modelFilepath.string().c_str());
 		return OBS_BGREMOVAL_ORT_SESSION_ERROR_FILE_NOT_FOUND;
 	}
 
-	tf->modelFilepath = modelFilepath.wstring();
+	build.modelFilepath = modelFilepath.wstring();
+
+	// Optimized model cache, CPU provider only: providers that compile fused partitions (DML) can't serialize their graph
+	const uint64_t hashStart = os_gettime_ns();
+	const std::filesystem::path cacheEntry = build.useGPU == USEGPU_CPU ? ModelCache::entryPath(modelFilepath, optionsKey) : std::filesystem::path();
+	const uint64_t hashNs = os_gettime_ns() - hashStart;
+	const char *cacheResult = cacheEntry.empty() ? "off" : "miss";
+
+	const uint64_t sessionStart = os_gettime_ns();
+	OrtSharedSession shared;
 
 	try
 	{
-		if (tf->useGPU == USEGPU_DML)
+		if (build.useGPU == USEGPU_DML)
 		{
 			auto &api = Ort::GetApi();
 			OrtDmlApi *dmlApi = nullptr;
@@ -209,25 +920,297 @@ int BgBlurGraphics::createOrtSession(FilterData *tf)
 			Ort::ThrowOnError(dmlApi->SessionOptionsAppendExecutionProvider_DML(sessionOptions, 0));
 		}
 
-		tf->session = std::make_unique<Ort::Session>(*tf->env, tf->modelFilepath.c_str(), sessionOptions);
+		if (!cacheEntry.empty() && ModelCache::isValid(cacheEntry))
+		{
+			// Already optimized at ORT_ENABLE_ALL when it was saved
+			Ort::SessionOptions cachedOptions = sessionOptions.Clone();
+			cachedOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+			cachedOptions.AddConfigEntry("session.load_model_format", "ORT");
+
+			// Initializers stay in the registry's read-only mapping of the entry instead of being copied per session
+			cachedOptions.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+			cachedOptions.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+
+			try
+			{
+				shared = OrtRegistry::instance().acquireSession(build.modelFilepath, optionsKey, cachedOptions, cacheEntry.wstring(), true);
+				cacheResult = "hit";
+			}
+			catch (const Ort::Exception &e)
+			{
+				blog(LOG_WARNING, "BgBlur optimized model cache entry %s is unusable, rebuilding: %s", cacheEntry.string().c_str(), e.what());
+				ModelCache::invalidate(cacheEntry);
+				cacheResult = "invalid";
+			}
+		}
+
+		if (!shared.session)
+		{
+			const std::filesystem::path pending = cacheEntry.empty() ? std::filesystem::path() : ModelCache::pendingPath(cacheEntry);
+
+			if (!pending.empty())
+			{
+				sessionOptions.SetOptimizedModelFilePath(pending.wstring().c_str());
+				sessionOptions.AddConfigEntry("session.save_model_format", "ORT");
+			}
+
+			shared = OrtRegistry::instance().acquireSession(build.modelFilepath, optionsKey, sessionOptions);
+
+			// Nothing was written when the registry already held the session
+			if (!pending.empty() && std::filesystem::exists(pending) && !ModelCache::commit(pending, cacheEntry))
+				blog(LOG_WARNING, "BgBlur could not save the optimized model to %s", cacheEntry.string().c_str());
+		}
 	}
 	catch (const std::exception &e)
 	{
 		blog(LOG_ERROR, "%s", e.what());
+		build.error = e.what();
 		return OBS_BGREMOVAL_ORT_SESSION_ERROR_STARTUP;
 	}
 
+	build.session = shared.session;
+	build.sessionRunLock = shared.runLock;
+	build.sessionId = shared.id;
+	build.warmupLock = std::move(shared.warmupLock);
+
+	// Cold start breakdown; the first inference is logged by the worker
+	blog(LOG_INFO, "BgBlur session startup: modelHash=%.1fms session=%.1fms optimizedModelCache=%s", (double)hashNs / 1000000.0,
+	     (double)(os_gettime_ns() - sessionStart) / 1000000.0, cacheResult);
+
 	Ort::AllocatorWithDefaultOptions allocator;
 
-	tf->model->populateInputOutputNames(tf->session, tf->inputNames, tf->outputNames);
+	build.model->populateInputOutputNames(build.session, build.inputNames, build.outputNames);
 
-	if (!tf->model->populateInputOutputShapes(tf->session, tf->inputDims, tf->outputDims))
+	if (!build.model->populateInputOutputShapes(build.session, build.inputDims, build.outputDims))
 	{
 		blog(LOG_ERROR, "Unable to get model input and output shapes");
 		return OBS_BGREMOVAL_ORT_SESSION_ERROR_INVALID_INPUT_OUTPUT;
 	}
 
+	// Batchable across instances: one input, one output, both with a dynamic batch dimension (the shapes above pin it to 1)
+	build.batchable = build.inputNames.size() == 1 && build.outputNames.size() == 1 && build.session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape().at(0) < 0 &&
+			build.session->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape().at(0) < 0;
+
 	// Allocate buffers
-	tf->model->allocateTensorBuffers(tf->inputDims, tf->outputDims, tf->outputTensorValues, tf->inputTensorValues, tf->inputTensor, tf->outputTensor);
+	build.model->allocateTensorBuffers(build.inputDims, build.outputDims, build.outputTensorValues, build.inputTensorValues, build.inputTensor, build.outputTensor);
+
+	uint32_t inputWidth, inputHeight;
+	build.model->getNetworkInputSize(build.inputDims, inputWidth, inputHeight);
+	build.networkWidth = inputWidth;
+	build.networkHeight = inputHeight;
 	return OBS_BGREMOVAL_ORT_SESSION_SUCCESS;
 }
+
+static const char *sessionErrorMessage(int result)
+{
+	switch (result)
+	{
+	case OBS_BGREMOVAL_ORT_SESSION_ERROR_FILE_NOT_FOUND:
+		return "model file not found";
+	case OBS_BGREMOVAL_ORT_SESSION_ERROR_INVALID_MODEL:
+		return "unknown model";
+	case OBS_BGREMOVAL_ORT_SESSION_ERROR_INVALID_INPUT_OUTPUT:
+		return "unexpected model inputs or outputs";
+	default:
+		return "ONNX Runtime failed to start";
+	}
+}
+
+static std::unique_ptr<Model> createModel(const std::string &modelSelection)
+{
+	if (modelSelection == MODEL_SINET)
+		return std::make_unique<ModelSINET>();
+	else if (modelSelection == MODEL_SELFIE)
+		return std::make_unique<ModelSelfie>();
+	else if (modelSelection == MODEL_MEDIAPIPE)
+		return std::make_unique<ModelMediaPipe>();
+	else if (modelSelection == MODEL_RVM)
+		return std::make_unique<ModelRVM>();
+	else if (modelSelection == MODEL_PPHUMANSEG)
+		return std::make_unique<ModelPPHumanSeg>();
+	else if (modelSelection == MODEL_DEPTH_TCMONODEPTH)
+		return std::make_unique<ModelTCMonoDepth>();
+	else if (modelSelection == MODEL_RMBG)
+		return std::make_unique<ModelRMBG>();
+
+	return nullptr;
+}
+
+/*static*/
+void BgBlurGraphics::warmUpSession(FilterData *tf, SessionBuild &build)
+{
+	// Lazy kernel init, memory pattern planning, arena growth and provider compilation all happen on the first runs.
+	//	Doing them here, on zeroed input before the session goes live, keeps them out of the first real frames.
+	//	Inputs are left as they were, so recurrent state still starts from zero. Only sessions this build created get here;
+	//	their run lock is still held from the registry, so instances sharing the session wait for the warm-up.
+	const uint64_t warmupStart = os_gettime_ns();
+	uint64_t lastRunNs = 0;
+
+	try
+	{
+		for (int run = 0; run < SESSION_WARMUP_RUNS; ++run)
+		{
+			const uint64_t runStart = os_gettime_ns();
+			build.model->runNetworkInference(build.session, build.inputNames, build.outputNames, build.inputTensor, build.outputTensor);
+			lastRunNs = os_gettime_ns() - runStart;
+		}
+	}
+	catch (const std::exception &e)
+	{
+		// Not fatal: the real frames will hit the same error, or warm the session themselves
+		blog(LOG_WARNING, "BgBlur session warm-up failed: %s", e.what());
+	}
+
+	build.warmupLock.unlock();
+
+	tf->stats.warmupNs = os_gettime_ns() - warmupStart;
+	tf->stats.warmupSteadyRunNs = lastRunNs;
+
+	blog(LOG_INFO, "BgBlur session warm-up: runs=%d total=%.1fms steadyRun=%.2fms", SESSION_WARMUP_RUNS, (double)tf->stats.warmupNs.load() / 1000000.0,
+	     (double)lastRunNs / 1000000.0);
+}
+
+/*static*/
+void BgBlurGraphics::installSession(FilterData *tf, SessionBuild &build)
+{
+	std::lock_guard<std::mutex> lock(tf->modelMutex);
+
+	// Swapped rather than moved: the old session and its buffers leave with the build and are released outside the lock
+	std::swap(static_cast<ORTModelData &>(*tf), static_cast<ORTModelData &>(build));
+	std::swap(tf->model, build.model);
+	std::swap(tf->modelFilepath, build.modelFilepath);
+	std::swap(tf->modelSelection, build.modelSelection);
+	std::swap(tf->useGPU, build.useGPU);
+	std::swap(tf->numThreads, build.numThreads);
+	tf->batchable = build.batchable;
+	tf->networkWidth = build.networkWidth;
+	tf->networkHeight = build.networkHeight;
+
+	// Fresh IO buffers, so the first masks are not steady state, and the worker drops state from the old model
+	tf->firstRunPending = true;
+	tf->scratch.invalidate();
+	tf->sessionGeneration++;
+}
+
+/*static*/
+void BgBlurGraphics::requestSession(FilterData *tf, const std::string &modelSelection, const std::string &useGPU, uint32_t numThreads)
+{
+	// Sessions are built and warmed on a loader thread. Until the first one is ready the filter passes frames through;
+	//	after that the running session keeps producing masks until its replacement is swapped in.
+	std::thread finished;
+
+	{
+		std::lock_guard<std::mutex> lock(tf->sessionRequestLock);
+
+		if (tf->sessionRequestId > 0 && modelSelection == tf->requestedModel && useGPU == tf->requestedUseGPU && numThreads == tf->requestedNumThreads)
+			return;
+
+		tf->requestedModel = modelSelection;
+		tf->requestedUseGPU = useGPU;
+		tf->requestedNumThreads = numThreads;
+		tf->sessionRequestId++;
+		tf->sessionError.clear();
+
+		if (tf->sessionState != SESSION_READY)
+			tf->sessionState = SESSION_LOADING;
+
+		// A loader still building picks up the newest request when it finishes
+		if (tf->sessionLoaderBusy)
+			return;
+
+		tf->sessionLoaderBusy = true;
+		finished = std::move(tf->sessionLoader);
+		tf->sessionLoader = std::thread(&BgBlurGraphics::runSessionLoader, tf);
+	}
+
+	// The previous loader is past its last step already
+	if (finished.joinable())
+		finished.join();
+}
+
+/*static*/
+void BgBlurGraphics::runSessionLoader(FilterData *tf)
+{
+	os_set_thread_name("bgblur-session-loader");
+
+	for (;;)
+	{
+		SessionBuild build;
+		uint64_t requestId;
+
+		{
+			std::lock_guard<std::mutex> lock(tf->sessionRequestLock);
+
+			if (tf->sessionLoaderStop)
+			{
+				tf->sessionLoaderBusy = false;
+				return;
+			}
+
+			build.modelSelection = tf->requestedModel;
+			build.useGPU = tf->requestedUseGPU;
+			build.numThreads = tf->requestedNumThreads;
+			requestId = tf->sessionRequestId;
+		}
+
+		const uint64_t start = os_gettime_ns();
+		build.model = createModel(build.modelSelection);
+
+		const int result = createOrtSession(build);
+
+		// A session taken from the registry cache is live in another instance and warm already
+		if (result == OBS_BGREMOVAL_ORT_SESSION_SUCCESS && build.warmupLock.owns_lock())
+			warmUpSession(tf, build);
+
+		std::unique_lock<std::mutex> lock(tf->sessionRequestLock);
+
+		// Superseded while building: build the newest request instead
+		if (requestId != tf->sessionRequestId && !tf->sessionLoaderStop)
+			continue;
+
+		if (tf->sessionLoaderStop)
+		{
+			tf->sessionLoaderBusy = false;
+			return;
+		}
+
+		if (result == OBS_BGREMOVAL_ORT_SESSION_SUCCESS)
+		{
+			installSession(tf, build);
+			blog(LOG_INFO, "BgBlur session %s (%s) ready in %.1f ms", tf->modelSelection.c_str(), tf->useGPU.c_str(), (double)(os_gettime_ns() - start) / 1000000.0);
+			tf->sessionState = SESSION_READY;
+		}
+		else
+		{
+			tf->sessionError = build.error.empty() ? sessionErrorMessage(result) : build.error;
+			blog(LOG_ERROR, "Failed to create ONNXRuntime session for %s. Error code: %d (%s)", build.modelSelection.c_str(), result, tf->sessionError.c_str());
+
+			// A failed swap leaves the running session in place
+			if (tf->sessionState != SESSION_READY)
+				tf->sessionState = SESSION_FAILED;
+		}
+
+		tf->sessionLoaderBusy = false;
+		lock.unlock();
+
+		// Swap the loading notice in the properties for the result
+		obs_source_update_properties(tf->source);
+		return;
+	}
+}
+
+/*static*/
+void BgBlurGraphics::joinSessionLoad(FilterData *tf)
+{
+	// Session creation can't be interrupted; destroying a filter mid-load waits for the build in progress
+	std::thread loader;
+
+	{
+		std::lock_guard<std::mutex> lock(tf->sessionRequestLock);
+		tf->sessionLoaderStop = true;
+		loader = std::move(tf->sessionLoader);
+	}
+
+	if (loader.joinable())
+		loader.join();
+}
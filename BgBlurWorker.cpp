@@ -0,0 +1,617 @@
+#include "FilterData.h"
+#include "BgBlur.h"
+
+#include <util\platform.h>
+
+#include <cstring>
+
+#include "Models.h"
+
+/*static*/
+void BgBlurWorker::start(FilterData *tf)
+{
+	{
+		std::lock_guard<std::mutex> lock(tf->inputBGRALock);
+		tf->maskWorkerStop = false;
+	}
+
+	tf->maskWorker = std::thread(&BgBlurWorker::run, tf);
+}
+
+/*static*/
+void BgBlurWorker::stop(FilterData *tf)
+{
+	{
+		std::lock_guard<std::mutex> lock(tf->inputBGRALock);
+		tf->maskWorkerStop = true;
+	}
+
+	tf->maskWorkerCv.notify_all();
+
+	if (tf->maskWorker.joinable())
+		tf->maskWorker.join();
+}
+
+/*static*/
+void BgBlurWorker::submitFrame(FilterData *tf, const cv::Mat &imageBGRA, uint64_t frameId, const FrameGeometry &geometry)
+{
+	// Called from the render thread. Overwrites any frame the worker has not picked up yet, so the worker
+	//	always processes the newest frame and never builds a backlog.
+	{
+		std::lock_guard<std::mutex> lock(tf->inputBGRALock);
+		imageBGRA.copyTo(tf->inputBGRA);
+		tf->inputFrameId = frameId;
+		tf->inputGeometry = geometry;
+	}
+
+	tf->maskWorkerCv.notify_one();
+}
+
+/*static*/
+bool BgBlurWorker::fetchMask(FilterData *tf)
+{
+	// Called from the render thread. Picks up the newest finished mask if there is one, without ever waiting on the worker.
+	//	Changed blur cache tiles are taken under the same lock, so a tile is only re-blurred together with the mask
+	//	it was reported with.
+
+	std::unique_lock<std::mutex> lock(tf->outputLock, std::try_to_lock);
+
+	if (!lock.owns_lock())
+		return false;
+
+	for (int i = 0; i < BLUR_CACHE_TILE_COUNT; ++i)
+	{
+		tf->blurCacheDirty[i] |= tf->publishedDirtyTiles[i];
+		tf->publishedDirtyTiles[i] = false;
+	}
+
+	if (tf->publishedMaskFrameId <= tf->backgroundMaskFrameId || tf->publishedMask.empty())
+		return false;
+
+	// Swap so the worker reuses our previous buffer for its next mask
+	std::swap(tf->backgroundMask, tf->publishedMask);
+	tf->backgroundMaskFrameId = tf->publishedMaskFrameId;
+	return true;
+}
+
+/*static*/
+void BgBlurWorker::run(FilterData *tf)
+{
+	os_set_thread_name("bgblur-mask-worker");
+
+	cv::Mat imageBGRA;
+	cv::Mat backgroundMask;
+	FrameGeometry geometry;
+	uint64_t processedFrameId = 0;
+
+	for (;;)
+	{
+		uint64_t frameId = 0;
+
+		{
+			std::unique_lock<std::mutex> lock(tf->inputBGRALock);
+			tf->maskWorkerCv.wait(lock, [&] { return tf->maskWorkerStop || tf->inputFrameId != processedFrameId; });
+
+			if (tf->maskWorkerStop)
+				return;
+
+			// Swap so the render thread copies its next frame into our previous buffer
+			std::swap(imageBGRA, tf->inputBGRA);
+			frameId = tf->inputFrameId;
+			geometry = tf->inputGeometry;
+		}
+
+		processedFrameId = frameId;
+
+		if (imageBGRA.empty())
+			continue;
+
+		{
+			std::lock_guard<std::mutex> lock(tf->settingsLock);
+			tf->maskSettings = tf->workerSettings;
+		}
+
+		bool built = false;
+		bool dirtyTiles[BLUR_CACHE_TILE_COUNT] = {};
+		const bool trackChanges = tf->maskSettings.enableBlurCache;
+
+		// A GPU-downscaled ROI frame only shows part of the source, so its thumbnails cannot place changes or motion in the frame
+		const bool wholeFrame = geometry.roiRect == cv::Rect(cv::Point(), geometry.frameSize) || imageBGRA.size() == geometry.frameSize;
+
+		try
+		{
+			// One thumbnail per frame feeds both the similarity gate and the blur cache change map
+			if (trackChanges || tf->maskSettings.enableImageSimilarity || tf->maskSettings.adaptiveCadence || tf->maskSettings.enableMaskPropagation)
+				tf->changeDetector.update(imageBGRA, geometry.contentRect);
+
+			// Every frame, not just the ones that get a new mask, so the cached blur follows the background
+			if (trackChanges && wholeFrame)
+				detectBlurCacheChanges(tf, dirtyTiles);
+			else if (trackChanges)
+				std::fill(std::begin(dirtyTiles), std::end(dirtyTiles), true);
+
+			const int result = buildMask(tf, imageBGRA, frameId, geometry, backgroundMask);
+			built = result == MASK_BUILD_BUILT;
+
+			if (tf->maskSettings.enableMaskPropagation)
+			{
+				if (built)
+					backgroundMask.copyTo(tf->propagationBase);
+				else if (wholeFrame)
+					built = propagateMask(tf, backgroundMask);
+			}
+
+			// A gated frame still confirms the previous mask is current; a failed build does not
+			if (built || result == MASK_BUILD_REUSED)
+				tf->maskCheckedFrameId = frameId;
+		}
+		catch (const Ort::Exception &e)
+		{
+			blog(LOG_ERROR, "ONNXRuntime Exception: %s", e.what());
+		}
+		catch (const std::exception &e)
+		{
+			blog(LOG_ERROR, "%s", e.what());
+		}
+
+		if (!built && !trackChanges)
+			continue;
+
+		// The blur is mask aware, so a new mask re-blurs the tiles it changed even over a static background
+		if (built && trackChanges)
+			detectBlurCacheMaskChanges(tf, backgroundMask, dirtyTiles);
+
+		{
+			// Dirty tiles go out together with the mask they were detected with, so the re-blur uses the matching mask
+			std::lock_guard<std::mutex> lock(tf->outputLock);
+
+			if (built)
+			{
+				std::swap(tf->publishedMask, backgroundMask);
+				tf->publishedMaskFrameId = frameId;
+			}
+
+			for (int i = 0; i < BLUR_CACHE_TILE_COUNT; ++i)
+				tf->publishedDirtyTiles[i] |= dirtyTiles[i];
+		}
+
+		if (built)
+			tf->stats.masksPublished++;
+	}
+}
+
+/*static*/
+void BgBlurWorker::detectBlurCacheChanges(FilterData *tf, bool *dirtyTiles)
+{
+	// The blur cache reference only takes a tile's new content once that tile is reported dirty, so slow drift
+	//	accumulates until it crosses the threshold instead of never being noticed.
+
+	if (tf->blurCacheReference.empty())
+	{
+		tf->changeDetector.capture(tf->blurCacheReference);
+		std::fill(dirtyTiles, dirtyTiles + BLUR_CACHE_TILE_COUNT, true);
+		return;
+	}
+
+	const cv::Mat &blockChanges = tf->changeDetector.blockChanges(tf->blurCacheReference);
+
+	for (int ty = 0; ty < BLUR_CACHE_TILES_Y; ++ty)
+	{
+		const uint8_t *row = blockChanges.ptr<uint8_t>(ty);
+
+		for (int tx = 0; tx < BLUR_CACHE_TILES_X; ++tx)
+		{
+			if (row[tx] < BLUR_CACHE_CHANGE_LEVEL)
+				continue;
+
+			dirtyTiles[ty * BLUR_CACHE_TILES_X + tx] = true;
+			tf->changeDetector.captureBlock(tf->blurCacheReference, tx, ty);
+		}
+	}
+}
+
+/*static*/
+void BgBlurWorker::detectBlurCacheMaskChanges(FilterData *tf, const cv::Mat &mask, bool *dirtyTiles)
+{
+	// Masks always cover the whole frame, whatever their resolution or type, so tiles map onto them proportionally
+	if (tf->blurCacheMask.size() != mask.size() || tf->blurCacheMask.type() != mask.type())
+	{
+		mask.copyTo(tf->blurCacheMask);
+		std::fill(dirtyTiles, dirtyTiles + BLUR_CACHE_TILE_COUNT, true);
+		return;
+	}
+
+	const size_t elemSize = mask.elemSize();
+
+	for (int ty = 0; ty < BLUR_CACHE_TILES_Y; ++ty)
+	{
+		const int y0 = ty * mask.rows / BLUR_CACHE_TILES_Y;
+		const int y1 = (ty + 1) * mask.rows / BLUR_CACHE_TILES_Y;
+
+		for (int tx = 0; tx < BLUR_CACHE_TILES_X; ++tx)
+		{
+			bool &dirty = dirtyTiles[ty * BLUR_CACHE_TILES_X + tx];
+
+			if (dirty)
+				continue;
+
+			const int x0 = tx * mask.cols / BLUR_CACHE_TILES_X;
+			const size_t bytes = (size_t)((tx + 1) * mask.cols / BLUR_CACHE_TILES_X - x0) * elemSize;
+
+			for (int y = y0; y < y1 && !dirty; ++y)
+				dirty = std::memcmp(mask.ptr(y) + x0 * elemSize, tf->blurCacheMask.ptr(y) + x0 * elemSize, bytes) != 0;
+		}
+	}
+
+	mask.copyTo(tf->blurCacheMask);
+}
+
+/*static*/
+bool BgBlurWorker::propagateMask(FilterData *tf, cv::Mat &backgroundMask)
+{
+	// Runs on the worker thread for frames the gates skipped: warps the newest mask along the motion between the
+	//	previous and this frame's change detector thumbnails. Returns true when a new mask was produced.
+
+	if (tf->propagationBase.empty() || !tf->changeDetector.hasFrame() || tf->changeDetector.motion() < PROPAGATION_MIN_MOTION)
+		return false;
+
+	const uint64_t propagationStart = os_gettime_ns();
+
+	if (!tf->propagator.estimate(tf->changeDetector.previousThumbnail(), tf->changeDetector.thumbnail()))
+		return false;
+
+	tf->propagator.warp(tf->propagationBase, backgroundMask);
+	backgroundMask.copyTo(tf->propagationBase);
+
+	tf->stats.propagationNs += os_gettime_ns() - propagationStart;
+	tf->stats.propagatedMasks++;
+	return true;
+}
+
+/*static*/
+int BgBlurWorker::buildMask(FilterData *tf, const cv::Mat &stagedBGRA, uint64_t frameId, const FrameGeometry &stagedGeometry, cv::Mat &backgroundMask)
+{
+	// Runs on the worker thread. Returns MASK_BUILD_BUILT when a new mask was produced for this frame, MASK_BUILD_REUSED
+	//	when the gates kept the previous mask and MASK_BUILD_FAILED when there is no mask for it.
+
+	if (tf->sessionState != SESSION_READY)
+		return MASK_BUILD_FAILED;
+
+	bool doProcess = true;
+
+	// Image-similarity skip (keep previous mask; DO NOT update the reference if we skip)
+	if (tf->maskSettings.enableImageSimilarity && tf->changeDetector.hasFrame() && !tf->similarityReference.empty())
+	{
+		const double psnr = tf->changeDetector.psnr(tf->similarityReference);
+		if (psnr > tf->maskSettings.imageSimilarityThreshold)
+			doProcess = false; // skip updating the mask this frame
+	}
+
+	// Mask update cadence: adaptive (scene motion and CPU budget), or every X frames
+	if (doProcess && tf->maskSettings.adaptiveCadence)
+	{
+		const bool run = tf->cadence.shouldRun(frameId, tf->changeDetector.motion(), tf->maskSettings.minMaskCadence, tf->maskSettings.maxMaskCadence,
+						       tf->maskSettings.inferenceBudgetMs);
+		tf->stats.maskCadence = (uint32_t)tf->cadence.cadence();
+
+		if (!run && tf->hasWorkerMask)
+			doProcess = false; // reuse previous mask
+	}
+	else if (doProcess && tf->maskSettings.maskEveryXFrames > 1)
+	{
+		tf->maskEveryXFramesCount = (tf->maskEveryXFramesCount + 1) % tf->maskSettings.maskEveryXFrames;
+		if (tf->maskEveryXFramesCount != 0 && tf->hasWorkerMask)
+			doProcess = false; // reuse previous mask
+	}
+
+	if (!doProcess)
+		return MASK_BUILD_REUSED;
+
+	// ROI crop. The GPU downscale already rendered only the ROI; a full-resolution staged frame is cropped here (a view).
+	cv::Mat imageBGRA = stagedBGRA;
+	FrameGeometry geometry = stagedGeometry;
+	const cv::Rect frameRect(cv::Point(), geometry.frameSize);
+
+	if (geometry.roiRect != frameRect && stagedBGRA.size() == geometry.frameSize && geometry.contentRect == frameRect)
+	{
+		imageBGRA = stagedBGRA(geometry.roiRect);
+		geometry.contentRect = cv::Rect(cv::Point(), geometry.roiRect.size());
+	}
+
+	// Every stage below borrows its buffers from the arena; every exit closes the arena frame
+	struct ScratchFrame
+	{
+		ScratchArena &arena;
+		~ScratchFrame() { arena.endFrame(); }
+	} scratchFrame{tf->scratch};
+	tf->scratch.beginFrame(geometry.frameSize, imageBGRA.size(), geometry.roiRect.size(), geometry.contentRect.size());
+
+	MaskPostParams params;
+	params.enableThreshold = tf->maskSettings.enableThreshold;
+	params.threshold = tf->maskSettings.threshold;
+	params.temporalSmoothFactor = tf->maskSettings.temporalSmoothFactor;
+	params.contourFilter = tf->maskSettings.contourFilter;
+	params.dilateIterations = tf->maskSettings.feather > 0.0f ? featherDilateIterations(tf->maskSettings.feather) : 0;
+
+	// Guided upsampling needs the full-resolution frame here, or the effect pass on the GPU. Its edges replace the
+	//	smoothing blur and re-binarize.
+	const bool guided = tf->maskSettings.guidedUpsample && (tf->maskSettings.gpuMaskUpsample || stagedBGRA.size() == geometry.frameSize);
+	params.smoothContour = guided ? 0.0f : tf->maskSettings.smoothContour;
+
+	const bool verify = tf->maskSettings.verifyMaskPostprocess;
+	cv::Mat mask;
+	uint64_t inferenceStart = 0;
+
+	{
+		// Process the image to find the mask.
+		std::unique_lock<std::mutex> lock(tf->modelMutex);
+
+		inferenceStart = os_gettime_ns();
+
+		cv::Mat output;
+
+		if (!BgBlurGraphics::runFilterModelInference(tf, imageBGRA, output))
+			return MASK_BUILD_FAILED;
+
+		const uint64_t inferenceNs = os_gettime_ns() - inferenceStart;
+		tf->stats.inferenceNs += inferenceNs;
+		tf->stats.inferenceCount++;
+
+		// A swapped-in session starts from fresh temporal state
+		if (tf->workerSessionGeneration != tf->sessionGeneration)
+		{
+			tf->workerSessionGeneration = tf->sessionGeneration;
+			tf->temporalHistory.release();
+			tf->verifyHistory.release();
+		}
+
+		if (tf->firstRunPending)
+		{
+			tf->firstRunPending = false;
+			blog(LOG_INFO, "BgBlur session first run: %.1fms", (double)inferenceNs / 1000000.0);
+		}
+
+		if (output.empty())
+		{
+			blog(LOG_WARNING, "Background mask is empty. Using previous mask.");
+			return MASK_BUILD_FAILED;
+		}
+
+		// Drop letterbox padding, mapping the content rect from the staged image onto the network output
+		cv::Mat content = output;
+
+		if (geometry.contentRect.size() != imageBGRA.size())
+		{
+			const double sx = (double)output.cols / imageBGRA.cols;
+			const double sy = (double)output.rows / imageBGRA.rows;
+			cv::Rect maskRect((int)std::lround(geometry.contentRect.x * sx), (int)std::lround(geometry.contentRect.y * sy), (int)std::lround(geometry.contentRect.width * sx),
+					  (int)std::lround(geometry.contentRect.height * sy));
+			maskRect &= cv::Rect(0, 0, output.cols, output.rows);
+
+			if (!maskRect.empty())
+				content = output(maskRect);
+		}
+
+		// The output may live in the session's tensor, so the first pass (convert, threshold) runs under the lock
+		mask = tf->scratch.get(SCRATCH_NETWORK_MASK, content.size(), CV_8UC1);
+		MaskPostProcessor::thresholdPass(content, params, mask);
+
+		if (verify)
+		{
+			cv::Mat &output8U = tf->scratch.get(SCRATCH_OUTPUT_8U, content.size(), CV_8UC1);
+			content.convertTo(output8U, CV_8U, 255.0);
+		}
+	}
+
+	// The temporal history restarts from the next mask whenever smoothing is switched back on
+	if (!MaskPostProcessor::temporalEnabled(params))
+	{
+		tf->temporalHistory.release();
+		tf->verifyHistory.release();
+	}
+
+	// The history is kept on the grid of the crop it was built from; follow the ROI when it moves or resizes
+	if (tf->temporalHistoryRoi != geometry.roiRect)
+	{
+		if (!tf->temporalHistory.empty())
+			tf->maskPostProcessor.remapHistory(tf->temporalHistory, tf->temporalHistoryRoi, mask, geometry.roiRect);
+
+		if (!tf->verifyHistory.empty())
+			tf->maskPostProcessor.remapHistory(tf->verifyHistory, tf->temporalHistoryRoi, mask, geometry.roiRect);
+	}
+
+	tf->temporalHistoryRoi = geometry.roiRect;
+	tf->maskPostProcessor.processNetworkMask(mask, params, tf->temporalHistory);
+
+	if (verify)
+	{
+		MaskPostProcessor::runLegacyNetwork(tf->scratch.at(SCRATCH_OUTPUT_8U), params, tf->verifyHistory, tf->verifyNetworkMask);
+		recordVerifyResult(tf, MaskPostProcessor::compare(mask, tf->verifyNetworkMask));
+	}
+
+	if (guided)
+	{
+		tf->guidedUpsampler.computeCoefficients(imageBGRA, geometry.contentRect, mask, tf->maskSettings.guidedRadius, tf->maskSettings.guidedEps,
+							tf->guidedCoefficients);
+
+		if (tf->maskSettings.gpuMaskUpsample)
+		{
+			// The mask effect applies them against the source; outside the ROI a = 0, b = 1 is background
+			pasteNetworkMask(tf, tf->guidedCoefficients, geometry, cv::Scalar(0.0, 1.0), backgroundMask);
+		}
+		else
+		{
+			const uint64_t fullResStart = os_gettime_ns();
+			tf->scratch.ensure(backgroundMask, geometry.frameSize, CV_8UC1);
+			tf->postprocessPool.resize(TilePool::share(tf->postprocessThreads));
+			tf->guidedUpsampler.apply(tf->guidedCoefficients, stagedBGRA, geometry.roiRect, tf->maskSettings.enableThreshold, backgroundMask, tf->postprocessPool);
+
+			if (params.dilateIterations > 0)
+				tf->maskPostProcessor.dilate(backgroundMask, params.dilateIterations, tf->postprocessPool);
+
+			tf->stats.fullResNs += os_gettime_ns() - fullResStart;
+			tf->stats.fullResCount++;
+		}
+	}
+	else if (tf->maskSettings.enableThreshold && !tf->maskSettings.gpuMaskUpsample)
+	{
+		// Resize mask back to source frame size; outside the ROI is background
+		tf->scratch.ensure(backgroundMask, geometry.frameSize, CV_8UC1);
+
+		const uint64_t fullResStart = os_gettime_ns();
+		tf->postprocessPool.resize(TilePool::share(tf->postprocessThreads));
+		tf->maskPostProcessor.processFullResMask(mask, params, geometry.roiRect, backgroundMask, tf->postprocessPool);
+		tf->stats.fullResNs += os_gettime_ns() - fullResStart;
+		tf->stats.fullResCount++;
+
+		if (verify)
+		{
+			// Same network mask into both, so this only measures the full-resolution stages
+			tf->verifyFullResMask.create(geometry.frameSize, CV_8UC1);
+			MaskPostProcessor::runLegacyFullRes(mask, params, geometry.roiRect, tf->verifyFullResMask);
+			recordVerifyResult(tf, MaskPostProcessor::compare(backgroundMask, tf->verifyFullResMask));
+		}
+	}
+	else
+	{
+		// Upload at network resolution; upsampling, re-binarizing and feathering happen in the effects
+		pasteNetworkMask(tf, mask, geometry, cv::Scalar(255), backgroundMask);
+	}
+
+	if (tf->maskSettings.enableRoiCrop)
+		updateInferenceRoi(tf, mask, geometry);
+
+	// Update the similarity reference only when we actually processed (mirrors original early-return behavior)
+	if (tf->maskSettings.enableImageSimilarity && tf->changeDetector.hasFrame())
+		tf->changeDetector.capture(tf->similarityReference);
+
+	// The cadence budget covers the whole mask build, not just the network
+	tf->cadence.recordRun(frameId, os_gettime_ns() - inferenceStart);
+
+	tf->hasWorkerMask = true;
+	return MASK_BUILD_BUILT;
+}
+
+/*static*/
+void BgBlurWorker::pasteNetworkMask(FilterData *tf, const cv::Mat &mask, const FrameGeometry &geometry, const cv::Scalar &outside, cv::Mat &backgroundMask)
+{
+	// Network resolution output. Without an ROI that is the mask as is; with one, the ROI mask is pasted into a
+	//	frame-aligned canvas of ROI_CANVAS_SCALE times the network resolution, so the ROI keeps its extra detail.
+	//	Also used for guided upsampling coefficients, with their own outside value.
+
+	if (geometry.roiRect == cv::Rect(cv::Point(), geometry.frameSize))
+	{
+		tf->scratch.ensure(backgroundMask, mask.size(), mask.type());
+		mask.copyTo(backgroundMask);
+		return;
+	}
+
+	const double netScale = std::max((double)tf->networkWidth / geometry.frameSize.width, (double)tf->networkHeight / geometry.frameSize.height);
+	const double scale = std::min(1.0, ROI_CANVAS_SCALE * netScale);
+	const cv::Size canvasSize(std::max(1, (int)std::lround(geometry.frameSize.width * scale)), std::max(1, (int)std::lround(geometry.frameSize.height * scale)));
+
+	cv::Rect canvasRoi((int)std::floor(geometry.roiRect.x * scale), (int)std::floor(geometry.roiRect.y * scale), (int)std::ceil(geometry.roiRect.width * scale),
+			   (int)std::ceil(geometry.roiRect.height * scale));
+	canvasRoi &= cv::Rect(cv::Point(), canvasSize);
+
+	tf->scratch.ensure(backgroundMask, canvasSize, mask.type());
+	backgroundMask.setTo(outside);
+
+	if (canvasRoi.empty())
+		return;
+
+	cv::Mat roiMask = backgroundMask(canvasRoi);
+	cv::resize(mask, roiMask, canvasRoi.size(), 0, 0, cv::INTER_AREA);
+}
+
+/*static*/
+void BgBlurWorker::updateInferenceRoi(FilterData *tf, const cv::Mat &mask, const FrameGeometry &geometry)
+{
+	// Next ROI: bounding box of the foreground components of this mask, padded, grown to the frame aspect ratio and a
+	//	minimum size, then smoothed (grows at once, shrinks slowly). Every ROI_FULL_FRAME_INTERVAL masks the whole frame
+	//	is run once, so subjects entering outside the ROI are picked up.
+
+	const cv::Rect frameRect(cv::Point(), geometry.frameSize);
+	cv::Rect next = frameRect;
+
+	if (++tf->roiMaskCount % ROI_FULL_FRAME_INTERVAL != 0)
+	{
+		// Background is 255
+		cv::compare(mask, cv::Scalar(128), tf->roiForeground, cv::CMP_LT);
+		const int count = cv::connectedComponentsWithStats(tf->roiForeground, tf->roiLabels, tf->roiStats, tf->roiCentroids, 8, CV_32S);
+		const int minArea = std::max(1, (int)(mask.total() * ROI_MIN_COMPONENT_FRACTION));
+
+		cv::Rect box;
+
+		for (int i = 1; i < count; ++i)
+		{
+			const int *stat = tf->roiStats.ptr<int>(i);
+
+			if (stat[cv::CC_STAT_AREA] >= minArea)
+				box |= cv::Rect(stat[cv::CC_STAT_LEFT], stat[cv::CC_STAT_TOP], stat[cv::CC_STAT_WIDTH], stat[cv::CC_STAT_HEIGHT]);
+		}
+
+		cv::Rect2f target(0.0f, 0.0f, (float)geometry.frameSize.width, (float)geometry.frameSize.height);
+
+		if (!box.empty())
+		{
+			// Mask pixels -> frame pixels
+			const float sx = (float)geometry.roiRect.width / (float)mask.cols;
+			const float sy = (float)geometry.roiRect.height / (float)mask.rows;
+			target = cv::Rect2f(geometry.roiRect.x + box.x * sx, geometry.roiRect.y + box.y * sy, box.width * sx, box.height * sy);
+
+			const float padX = target.width * ROI_PADDING, padY = target.height * ROI_PADDING;
+			target.x -= padX;
+			target.y -= padY;
+			target.width += 2.0f * padX;
+			target.height += 2.0f * padY;
+
+			// Same aspect as the frame, so the network sees the same proportions as without a crop
+			const float aspect = (float)geometry.frameSize.width / (float)geometry.frameSize.height;
+			const float width = std::max({target.width, target.height * aspect, geometry.frameSize.width * ROI_MIN_FRACTION});
+			const float height = width / aspect;
+			target = cv::Rect2f(target.x + (target.width - width) * 0.5f, target.y + (target.height - height) * 0.5f, width, height);
+
+			// Shift inside the frame rather than clip, to keep the aspect
+			target.width = std::min(target.width, (float)geometry.frameSize.width);
+			target.height = std::min(target.height, (float)geometry.frameSize.height);
+			target.x = std::clamp(target.x, 0.0f, geometry.frameSize.width - target.width);
+			target.y = std::clamp(target.y, 0.0f, geometry.frameSize.height - target.height);
+		}
+
+		cv::Rect2f &roi = tf->roiSmoothed;
+
+		if (roi.empty() || (roi & target).area() <= 0.0f || roi.br().x > geometry.frameSize.width || roi.br().y > geometry.frameSize.height)
+		{
+			roi = target;
+		}
+		else
+		{
+			// Each edge grows to the target at once and shrinks towards it slowly
+			float left = target.x < roi.x ? target.x : roi.x + (target.x - roi.x) * ROI_SHRINK_RATE;
+			float top = target.y < roi.y ? target.y : roi.y + (target.y - roi.y) * ROI_SHRINK_RATE;
+			float right = target.br().x > roi.br().x ? target.br().x : roi.br().x + (target.br().x - roi.br().x) * ROI_SHRINK_RATE;
+			float bottom = target.br().y > roi.br().y ? target.br().y : roi.br().y + (target.br().y - roi.br().y) * ROI_SHRINK_RATE;
+			roi = cv::Rect2f(left, top, right - left, bottom - top);
+		}
+
+		next = cv::Rect((int)std::floor(roi.x), (int)std::floor(roi.y), (int)std::ceil(roi.width), (int)std::ceil(roi.height)) & frameRect;
+
+		if (next.empty())
+			next = frameRect;
+	}
+
+	std::lock_guard<std::mutex> lock(tf->inputBGRALock);
+	tf->inferenceRoi = next;
+}
+
+/*static*/
+void BgBlurWorker::recordVerifyResult(FilterData *tf, const MaskVerifyResult &result)
+{
+	tf->stats.verifyPixels += result.pixels;
+	tf->stats.verifyMismatchedPixels += result.mismatchedPixels;
+
+	uint64_t maxDifference = tf->stats.verifyMaxDifference;
+	while ((uint64_t)result.maxDifference > maxDifference && !tf->stats.verifyMaxDifference.compare_exchange_weak(maxDifference, (uint64_t)result.maxDifference))
+		;
+}
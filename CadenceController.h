@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Frame-to-frame motion (mean absolute luma difference of the change detector thumbnail, 8-bit levels) at which
+//	the cadence backs off to the maximum, and at which it ramps up to the minimum
+#define CADENCE_MOTION_STILL 0.75
+#define CADENCE_MOTION_FAST 6.0
+#define CADENCE_INFERENCE_EMA_ALPHA 0.1
+
+/**
+ * Motion-adaptive inference cadence
+ * Picks per frame whether the mask worker runs inference. The cadence (run every Nth frame) follows scene motion
+ * between the min and max settings, and never drops below what the CPU budget allows: with an inference time of T ms
+ * and a budget of B ms per frame, at most every ceil(T / B)th frame can run, even when that is past the max setting. Frames are counted in render frame ids,
+ * so frames the worker never saw (because it was busy) count towards the cadence too.
+ */
+class CadenceController
+{
+public:
+	bool shouldRun(uint64_t frameId, double motion, int minCadence, int maxCadence, float budgetMs)
+	{
+		minCadence = std::max(1, minCadence);
+		maxCadence = std::max(minCadence, maxCadence);
+
+		// Motion maps linearly from the max cadence (still) down to the min cadence (fast)
+		const double t = std::clamp((motion - CADENCE_MOTION_STILL) / (CADENCE_MOTION_FAST - CADENCE_MOTION_STILL), 0.0, 1.0);
+		int target = std::clamp((int)std::lround(maxCadence + (minCadence - maxCadence) * t), minCadence, maxCadence);
+
+		// The budget wins over the max setting: a slow model runs less often than asked rather than overrunning
+		if (budgetMs > 0.0f && inferenceMsEma > 0.0)
+			target = std::max(target, (int)std::ceil(inferenceMsEma / budgetMs));
+
+		currentCadence = target;
+
+		return lastRunFrameId == 0 || frameId - lastRunFrameId >= (uint64_t)currentCadence;
+	}
+
+	// Call once a mask was built for frameId, with the CPU time it took
+	void recordRun(uint64_t frameId, uint64_t elapsedNs)
+	{
+		const double ms = (double)elapsedNs / 1000000.0;
+		inferenceMsEma = inferenceMsEma > 0.0 ? inferenceMsEma + (ms - inferenceMsEma) * CADENCE_INFERENCE_EMA_ALPHA : ms;
+		lastRunFrameId = frameId;
+	}
+
+	int cadence() const { return currentCadence; }
+
+private:
+	double inferenceMsEma = 0.0;
+	uint64_t lastRunFrameId = 0;
+	int currentCadence = 1;
+};
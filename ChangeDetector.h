@@ -0,0 +1,103 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cfloat>
+#include <cmath>
+
+// Change map grid and block size in thumbnail pixels; the thumbnail is CHANGE_MAP_BLOCKS_X * CHANGE_MAP_BLOCK_SIZE wide
+#define CHANGE_MAP_BLOCKS_X 16
+#define CHANGE_MAP_BLOCKS_Y 9
+#define CHANGE_MAP_BLOCK_SIZE 8
+
+// Thumbnail PSNR above which a frame counts as unchanged. Each thumbnail pixel averages ~15x15 pixels of a 1080p frame,
+//	so sensor noise drops by ~23 dB and a full-resolution threshold such as 35 dB would skip real motion. 48 dB is an RMS luma
+//	difference of ~1 level, about the mean absolute difference the cadence treats as still (CADENCE_MOTION_STILL).
+#define CHANGE_SIMILARITY_PSNR_DB 48.0
+
+/**
+ * Thumbnail change detector
+ * Each frame is reduced once to a small luma thumbnail (area average, so sensor noise mostly cancels out), and every
+ * comparison runs on that: a global PSNR score and a per-block mean absolute difference. References are thumbnails
+ * captured from earlier frames, owned by the caller, so no full-resolution history is kept. The previous thumbnail is
+ * kept as well, for a frame-to-frame motion estimate.
+ */
+class ChangeDetector
+{
+public:
+	static cv::Size thumbnailSize() { return cv::Size(CHANGE_MAP_BLOCKS_X * CHANGE_MAP_BLOCK_SIZE, CHANGE_MAP_BLOCKS_Y * CHANGE_MAP_BLOCK_SIZE); }
+
+	// Reduce the part of the BGRA frame that holds the source (letterbox padding excluded) to the luma thumbnail
+	void update(const cv::Mat &imageBGRA, const cv::Rect &contentRect)
+	{
+		cv::Rect content = contentRect & cv::Rect(0, 0, imageBGRA.cols, imageBGRA.rows);
+
+		if (content.empty())
+			content = cv::Rect(0, 0, imageBGRA.cols, imageBGRA.rows);
+
+		std::swap(thumb, previousThumb);
+		cv::resize(imageBGRA(content), thumbBGRA, thumbnailSize(), 0, 0, cv::INTER_AREA);
+		cv::cvtColor(thumbBGRA, thumb, cv::COLOR_BGRA2GRAY);
+
+		// Mean absolute luma difference to the previous update, in 8-bit levels
+		frameMotion = previousThumb.size() == thumb.size() ? cv::norm(thumb, previousThumb, cv::NORM_L1) / (double)thumb.total() : 255.0;
+	}
+
+	bool hasFrame() const { return !thumb.empty(); }
+
+	double motion() const { return frameMotion; }
+
+	const cv::Mat &thumbnail() const { return thumb; }
+	const cv::Mat &previousThumbnail() const { return previousThumb; }
+
+	// Global score of the current thumbnail against a reference, in dB like cv::PSNR. Higher means more similar.
+	double psnr(const cv::Mat &reference) const
+	{
+		if (reference.size() != thumb.size() || reference.type() != thumb.type())
+			return 0.0;
+
+		// Same formula as cv::PSNR, on the thumbnail
+		const double rmse = std::sqrt(cv::norm(thumb, reference, cv::NORM_L2SQR) / (double)thumb.total());
+		return 20.0 * std::log10(255.0 / (rmse + DBL_EPSILON));
+	}
+
+	// CHANGE_MAP_BLOCKS_X x CHANGE_MAP_BLOCKS_Y map of the mean absolute luma difference per block (8-bit)
+	const cv::Mat &blockChanges(const cv::Mat &reference)
+	{
+		if (reference.size() != thumb.size() || reference.type() != thumb.type())
+		{
+			blockMap.create(CHANGE_MAP_BLOCKS_Y, CHANGE_MAP_BLOCKS_X, CV_8UC1);
+			blockMap.setTo(255);
+			return blockMap;
+		}
+
+		// Area resize by an integer factor is exactly the per-block mean
+		cv::absdiff(thumb, reference, diff);
+		cv::resize(diff, blockMap, cv::Size(CHANGE_MAP_BLOCKS_X, CHANGE_MAP_BLOCKS_Y), 0, 0, cv::INTER_AREA);
+		return blockMap;
+	}
+
+	// Make the current thumbnail the reference, all of it or one block
+	void capture(cv::Mat &reference) const { thumb.copyTo(reference); }
+
+	void captureBlock(cv::Mat &reference, int blockX, int blockY) const
+	{
+		if (reference.size() != thumb.size() || reference.type() != thumb.type())
+		{
+			capture(reference);
+			return;
+		}
+
+		const cv::Rect block(blockX * CHANGE_MAP_BLOCK_SIZE, blockY * CHANGE_MAP_BLOCK_SIZE, CHANGE_MAP_BLOCK_SIZE, CHANGE_MAP_BLOCK_SIZE);
+		thumb(block).copyTo(reference(block));
+	}
+
+private:
+	cv::Mat thumbBGRA;
+	cv::Mat thumb;
+	cv::Mat previousThumb;
+	cv::Mat diff;
+	cv::Mat blockMap;
+	double frameMotion = 255.0;
+};
@@ -3,6 +3,18 @@
 #include <obs.h>
 #include <obs-module.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "CadenceController.h"
+#include "ChangeDetector.h"
+#include "GuidedUpsampler.h"
+#include "MaskPostProcessor.h"
+#include "MaskPropagator.h"
 #include "Models.h"
 
 #define MODEL_SINET "SINet_Softmax_simple.onnx"
@@ -22,36 +34,290 @@
 #define USEGPU_TENSORRT "tensorrt"
 #define USEGPU_COREML "coreml"
 
+#define DOWNSCALE_OFF "off"
+#define DOWNSCALE_STRETCH "stretch"
+#define DOWNSCALE_LETTERBOX "letterbox"
+
+#define BLUR_MODE_KAWASE "kawase"
+#define BLUR_MODE_DUAL_KAWASE "dual_kawase"
+
+#define STATS_LOG_INTERVAL_SECONDS 10.0f
+#define READBACK_RING_MAX_DEPTH 4
+#define GPU_TIMER_RING_DEPTH 3
+#define DUAL_KAWASE_MAX_LEVELS 5
+#define DOWNSCALE_MAX_LEVELS 4 // halving passes before the final resize to the network input
+#define MASK_DILATE_MAX_RADIUS 16 // feather dilation taps per side on the GPU, matches PSMaskDilate
+
+// Cached background blur: one tile per change map block, and the mean 8-bit luma difference that dirties a tile
+#define BLUR_CACHE_TILES_X CHANGE_MAP_BLOCKS_X
+#define BLUR_CACHE_TILES_Y CHANGE_MAP_BLOCKS_Y
+#define BLUR_CACHE_TILE_COUNT (BLUR_CACHE_TILES_X * BLUR_CACHE_TILES_Y)
+#define BLUR_CACHE_CHANGE_LEVEL 6
+
+// Inference ROI: padding per side and minimum width as fractions of the subject box / frame, how fast the ROI shrinks
+//	per mask, smallest foreground component that counts, full-frame inference interval (in masks), and the resolution
+//	of the pasted mask relative to the network input when it is upsampled on the GPU
+#define ROI_PADDING 0.15f
+#define ROI_MIN_FRACTION 0.3f
+#define ROI_SHRINK_RATE 0.2f
+#define ROI_MIN_COMPONENT_FRACTION 0.005
+#define ROI_FULL_FRAME_INTERVAL 30
+#define ROI_CANVAS_SCALE 2.0
+
+// Upper bound for the full-resolution mask stage workers; past this the stages are memory bound
+#define POSTPROCESS_MAX_THREADS 8
+
+// Mask worker pass outcomes
+#define MASK_BUILD_FAILED 0 // no mask for this frame
+#define MASK_BUILD_REUSED 1 // gated, the previous mask stands for this frame
+#define MASK_BUILD_BUILT 2
+
+// Session lifecycle: built on a background thread, the filter passes frames through until it is ready
+#define SESSION_LOADING 0
+#define SESSION_READY 1
+#define SESSION_FAILED 2
+
+// Dummy inferences run on a new session before it goes live
+#define SESSION_WARMUP_RUNS 3
+
+// Anti-aliased edge half-width (mask units) when the guided mask effect pass re-binarizes
+#define GUIDED_MASK_EDGE_WIDTH 0.05f
+
+// Where a staged frame came from: the source size the mask is composited at, the part of the source the frame was
+//	taken from (the whole frame unless an inference ROI is active), and the part of the staged image that holds it
+//	(anything outside is letterbox padding)
+struct FrameGeometry
+{
+	cv::Size frameSize;
+	cv::Rect roiRect;
+	cv::Rect contentRect;
+};
+
+// Dilation (3x3, iterated) applied to the background mask for a given feather amount
+static inline int featherDilateIterations(float feather)
+{
+	const int k = std::max(3, 2 * (int)std::round(feather) + 1);
+	return std::max(1, k / 3);
+}
+
+// Workers for the full-resolution mask stages (0 = auto), for the whole process: every instance's pool gets its
+//	TilePool::share(). They run after inference on the mask worker threads, so on the CPU provider they reuse the
+//	cores ORT's global intra-op pool already claims instead of adding more; a GPU provider leaves those idle, so up to
+//	half the machine is taken. One core always stays free for the render thread.
+static inline uint32_t postprocessThreadCount(int setting, const std::string &useGPU, uint32_t ortThreads)
+{
+	const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	const uint32_t available = std::min(std::max(1u, cores - 1), (uint32_t)POSTPROCESS_MAX_THREADS);
+
+	uint32_t workers;
+
+	if (setting > 0)
+		workers = (uint32_t)setting;
+	else if (useGPU == USEGPU_CPU)
+		workers = ortThreads;
+	else
+		workers = cores / 2;
+
+	return std::clamp(workers, 1u, available);
+}
+
+// GPU timestamp query pair, read back a few frames after it was issued
+struct GpuTimerSlot
+{
+	gs_timer_range_t *range = nullptr;
+	gs_timer_t *timer = nullptr;
+	bool pending = false;
+};
+
+// Runtime counters, written from the render and worker threads and logged from video_tick
+struct FilterStats
+{
+	std::atomic<uint64_t> framesRendered{0};
+	std::atomic<uint64_t> masksPublished{0};
+	std::atomic<uint64_t> staleMaskFrames{0};
+	std::atomic<uint64_t> maskLagFrames{0};
+	std::atomic<uint64_t> maxMaskLagFrames{0};
+	std::atomic<uint64_t> inferenceCount{0};
+	std::atomic<uint64_t> inferenceNs{0};
+	std::atomic<uint64_t> stagedFrames{0};
+	std::atomic<uint64_t> stagedBytes{0};
+	std::atomic<uint64_t> renderNs{0};
+	std::atomic<uint64_t> blurGpuNs{0};
+	std::atomic<uint64_t> blurGpuSamples{0};
+	std::atomic<uint64_t> blurCacheFullRedraws{0};
+	std::atomic<uint64_t> blurCacheTilesRedrawn{0};
+	std::atomic<uint32_t> maskCadence{1};
+	std::atomic<uint64_t> propagatedMasks{0};
+	std::atomic<uint64_t> propagationNs{0};
+	std::atomic<uint64_t> batchedInferences{0};
+	std::atomic<uint64_t> batchSizeSum{0};
+	std::atomic<uint64_t> fullResCount{0};
+	std::atomic<uint64_t> fullResNs{0};
+	std::atomic<uint64_t> verifyPixels{0};
+	std::atomic<uint64_t> verifyMismatchedPixels{0};
+	std::atomic<uint64_t> verifyMaxDifference{0};
+	std::atomic<uint64_t> warmupNs{0};          // last session warm-up, total
+	std::atomic<uint64_t> warmupSteadyRunNs{0}; // last session warm-up, final run
+	float secondsSinceLog = 0.0f;
+};
+
+// Settings the mask worker reads. obs_update_settings publishes them under settingsLock and the worker copies them
+//	once per frame, so each mask is built from one consistent set
+struct MaskWorkerSettings
+{
+	bool enableThreshold = true;
+	float threshold = 0.5f;
+	float temporalSmoothFactor = 0.0f;
+	float contourFilter = 0.05f;
+	float smoothContour = 1.0f;
+	float feather = 0.0f;
+	bool gpuMaskUpsample = false;
+	bool guidedUpsample = false;
+	int guidedRadius = 2;
+	float guidedEps = 0.005f;
+	int maskEveryXFrames = 1;
+	bool adaptiveCadence = false;
+	int minMaskCadence = 1;
+	int maxMaskCadence = 6;
+	float inferenceBudgetMs = 0.0f;
+	bool enableMaskPropagation = false;
+	bool enableRoiCrop = false;
+	bool enableImageSimilarity = true;
+	float imageSimilarityThreshold = (float)CHANGE_SIMILARITY_PSNR_DB;
+	bool enableBlurCache = false;
+	bool verifyMaskPostprocess = false;
+	bool batchInference = false;
+};
+
+// A session and its IO buffers as built by the session loader, off the mask worker, and swapped in whole under modelMutex
+struct SessionBuild : public ORTModelData
+{
+	std::string modelSelection;
+	std::string useGPU;
+	uint32_t numThreads = 0;
+	std::unique_ptr<Model> model;
+	std::wstring modelFilepath;
+	bool batchable = false;
+	uint32_t networkWidth = 0;
+	uint32_t networkHeight = 0;
+	std::string error; // exception text of a failed build
+	std::unique_lock<std::mutex> warmupLock; // the session's run lock when this build created it, see OrtSharedSession
+};
+
 struct FilterData : public ORTModelData
 {
 public:
 	// Inference / Model configuration 
 	std::string useGPU = USEGPU_DML;
-	uint32_t numThreads = 1;
+	uint32_t numThreads = 0; // CPU intra-op threads of a session's own pools, 0 = the shared global pools
+	bool batchInference = false; // batch with other instances on the same session, see InferenceScheduler
+	bool batchable = false;      // set at session creation
+	std::atomic<uint32_t> postprocessThreads{1}; // process-wide worker budget for the full-resolution mask stages, see postprocessThreadCount
 	std::string modelSelection;
 	std::unique_ptr<Model> model;
 	std::wstring modelFilepath;
-	std::mutex modelMutex;
+	std::mutex modelMutex; // guards the session and its buffers, and useGPU, numThreads, batchable and the model fields of the installed session
+	std::atomic<int> sessionState{SESSION_LOADING};
+	uint64_t sessionGeneration = 0; // guarded by modelMutex, bumped by every installed session
+	bool firstRunPending = false; // guarded by modelMutex, logs the first inference of a new session
+
+	// Session requests, from obs_update_settings to the loader thread
+	std::mutex sessionRequestLock;
+	std::thread sessionLoader;        // guarded by sessionRequestLock
+	std::string requestedModel;       // guarded by sessionRequestLock
+	std::string requestedUseGPU;      // guarded by sessionRequestLock
+	uint32_t requestedNumThreads = 0; // guarded by sessionRequestLock
+	uint64_t sessionRequestId = 0;    // guarded by sessionRequestLock
+	bool sessionLoaderBusy = false;   // guarded by sessionRequestLock
+	bool sessionLoaderStop = false;   // guarded by sessionRequestLock
+	std::string sessionError;         // guarded by sessionRequestLock, why the last load failed
+	std::atomic<uint32_t> networkWidth{0};
+	std::atomic<uint32_t> networkHeight{0};
 
 	// OBS / Graphics handles
 	obs_source_t *source = nullptr;
 	gs_texrender_t *texrender = nullptr;
-	gs_stagesurf_t *stagesurface = nullptr;
+	gs_texrender_t *downscaleTexrender = nullptr;
+	gs_texrender_t *downscaleLevelTexrenders[DOWNSCALE_MAX_LEVELS] = {}; // halving chain in front of downscaleTexrender
+	gs_stagesurf_t *stagesurfaces[READBACK_RING_MAX_DEPTH] = {};
+	uint64_t stagesurfaceFrameIds[READBACK_RING_MAX_DEPTH] = {}; // 0 = nothing staged yet
+	FrameGeometry stagesurfaceGeometry[READBACK_RING_MAX_DEPTH];
+	uint32_t stagesurfaceCount = 0;
+	uint32_t stagesurfaceIndex = 0;
+	gs_texrender_t *guidedMaskTexrender = nullptr; // full-resolution mask resolved from guided coefficients
+	gs_texrender_t *maskDilateTexrenders[2] = {}; // separable feather dilation of a GPU-upsampled mask
+	bool maskDilatedOnGpu = false;               // this frame's mask came out of maskDilateTexrenders
+	gs_texture_t *maskTexture = nullptr;    // GS_DYNAMIC, updated when a new mask is committed
+	gs_texrender_t *blurTexrenders[2] = {}; // blur ping-pong targets
+	gs_texrender_t *dualKawaseTexrenders[DUAL_KAWASE_MAX_LEVELS] = {}; // pyramid levels 1..N
+	gs_texrender_t *blurCacheTexrender = nullptr; // blurred background kept across frames, alpha 0 = never seen
+	GpuTimerSlot blurTimers[GPU_TIMER_RING_DEPTH];
+	uint32_t blurTimerIndex = 0;
 	gs_effect_t *maskEffect = nullptr;
 	gs_effect_t *kawaseBlurEffect = nullptr;
 
-	// Frame data
-	cv::Mat inputBGRA;
+	// Frame data (render thread)
+	cv::Mat inputBGRA;           // guarded by inputBGRALock
+	uint64_t inputFrameId = 0;   // guarded by inputBGRALock
+	FrameGeometry inputGeometry; // guarded by inputBGRALock
+	cv::Rect inferenceRoi;       // guarded by inputBGRALock, source region the next frames are inferred on (empty = whole frame)
+	uint64_t frameCounter = 0;
 	cv::Mat backgroundMask;
-	cv::Mat lastBackgroundMask;
-	cv::Mat lastImageBGRA;
+	uint64_t backgroundMaskFrameId = 0;
+	bool maskTextureStale = false; // backgroundMask has not been uploaded to maskTexture yet
+	bool blurCacheDirty[BLUR_CACHE_TILE_COUNT] = {};
+	bool blurCacheValid = false;
+	cv::Size blurCacheSize;
+	std::vector<gs_rect> blurCacheRects;
+
+	// Frame data (mask worker)
+	MaskWorkerSettings maskSettings; // snapshot of workerSettings for the frame being processed
+	cv::Mat temporalHistory; // per-pixel EMA of the soft network mask (CV_16UC1, 8.8 fixed point)
+	cv::Rect temporalHistoryRoi; // frame rect temporalHistory covers
+	uint64_t workerSessionGeneration = 0; // session generation the worker state above was built with
+	ChangeDetector changeDetector;
+	cv::Mat similarityReference; // change detector thumbnail of the last frame a mask was built for
+	CadenceController cadence;
+	MaskPropagator propagator;
+	cv::Mat propagationBase; // newest mask the worker produced, inferred or propagated
+	cv::Rect2f roiSmoothed;
+	uint32_t roiMaskCount = 0;
+	cv::Mat roiForeground;
+	cv::Mat roiLabels;
+	cv::Mat roiStats;
+	cv::Mat roiCentroids;
+	bool hasWorkerMask = false;
+	ScratchArena scratch;
+	MaskPostProcessor maskPostProcessor;
+	TilePool postprocessPool; // full-resolution mask stages, owned by the worker thread
+	GuidedUpsampler guidedUpsampler;
+	cv::Mat guidedCoefficients; // CV_32FC2 (a, b) at network resolution
+	cv::Mat verifyHistory;     // legacy path state for verify mode
+	cv::Mat verifyNetworkMask;
+	cv::Mat verifyFullResMask;
+	cv::Mat blurCacheReference;  // change detector thumbnail as of the last time each tile was reported dirty
+	cv::Mat blurCacheMask;       // newest mask published with the blur cache dirty tiles
+
+	// Finished mask handed from the worker to the render thread
+	cv::Mat publishedMask;            // guarded by outputLock
+	uint64_t publishedMaskFrameId = 0; // guarded by outputLock
+	bool publishedDirtyTiles[BLUR_CACHE_TILE_COUNT] = {}; // guarded by outputLock, accumulated until fetchMask takes them with the mask
+	std::atomic<uint64_t> maskCheckedFrameId{0}; // newest frame the worker has built or validated a mask for
 
 	// Concurrency
+	std::mutex settingsLock;
+	MaskWorkerSettings workerSettings; // guarded by settingsLock
 	std::mutex inputBGRALock;
 	std::mutex outputLock;
+	std::thread maskWorker;
+	std::condition_variable maskWorkerCv;
+	bool maskWorkerStop = false; // guarded by inputBGRALock
 
 	// State flags
 	bool isDisabled = false;
+	bool enableStats = false;
+	bool verifyMaskPostprocess = false; // also run the legacy OpenCV mask chain and log how far the results differ
+	FilterStats stats;
 
 	// Threshold / Masking controls
 	bool enableThreshold = true; 
@@ -60,16 +326,32 @@ public:
 	float contourFilter = 0.05f; 
 	float smoothContour = 1.0f;  
 	float feather = 0.0f;        
+	bool gpuMaskUpsample = false; // keep the mask at network resolution and upsample it in the effects
+	bool guidedUpsample = false;  // edge-aware upsampling against the frame (fast guided filter) instead of bilinear
+	int guidedRadius = 2;         // box radius in network-resolution pixels
+	float guidedEps = 0.005f;     // regularization; smaller follows image edges more closely
 	int maskEveryXFrames = 1;    
 	int maskEveryXFramesCount = 0;
+	bool adaptiveCadence = false; // replaces maskEveryXFrames with the motion / budget driven cadence
+	int minMaskCadence = 1;
+	int maxMaskCadence = 6;
+	float inferenceBudgetMs = 0.0f; // inference CPU time allowed per frame, 0 = unlimited
+	bool enableMaskPropagation = false; // warp the last mask along the motion on frames without inference
+	bool enableRoiCrop = false;         // infer on a crop around the subject instead of the whole frame
+	int maxMaskLagFrames = 0; // 0 = uncapped
+	uint32_t readbackRingDepth = 3; // 1 = map in the same frame (lowest latency, full GPU sync)
+	std::string downscaleMode = DOWNSCALE_OFF; // scale to the network input on the GPU before readback
 
 	// Similarity & temporal smoothing
 	float temporalSmoothFactor = 0.0f;     
-	float imageSimilarityThreshold = 35.0f;
+	float imageSimilarityThreshold = (float)CHANGE_SIMILARITY_PSNR_DB;
 	bool enableImageSimilarity = true;     
 
 	// Blur / Depth settings
 	int64_t blurBackground = 10; 
+	std::string blurMode = BLUR_MODE_KAWASE;
+	bool enableBlurCache = false;             // re-blur only the tiles that changed (static cameras)
+	float blurCacheFullRedrawFraction = 0.5f; // dirty tile fraction above which the whole frame is re-blurred
 	float blurFocusPoint = 0.1f; 
 	float blurFocusDepth = 0.0f; 
 	bool enableFocalBlur = false;
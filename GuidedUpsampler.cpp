@@ -0,0 +1,276 @@
+#include "GuidedUpsampler.h"
+#include "Preprocess.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Output kernels for applyRows: a and b blended between the two interpolated coefficient rows, times the guide luma.
+//	Each returns how far it got; the scalar loop finishes the row. Same operation order as the scalar code.
+#if defined(BGBLUR_PREPROCESS_X86)
+
+BGBLUR_TARGET_AVX2 static inline int applyRowAVX2(const float *r0, const float *r1, float wy, const uint8_t *g, int width, bool binarize, float lumaScale, uint8_t *out)
+{
+	const __m256 weightY = _mm256_set1_ps(wy), scale = _mm256_set1_ps(lumaScale);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f), full = _mm256_set1_ps(255.0f);
+	const __m256i byteMask = _mm256_set1_epi32(0xFF), fullByte = _mm256_set1_epi32(255);
+	const __m256i lumaB = _mm256_set1_epi32(GUIDE_LUMA_B), lumaG = _mm256_set1_epi32(GUIDE_LUMA_G), lumaR = _mm256_set1_epi32(GUIDE_LUMA_R);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		// Interleaved (a, b) pairs: blend, then split into 8 a and 8 b in pixel order
+		const __m256 lo0 = _mm256_loadu_ps(r0 + 2 * x), hi0 = _mm256_loadu_ps(r0 + 2 * x + 8);
+		const __m256 lo = _mm256_add_ps(lo0, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(r1 + 2 * x), lo0), weightY));
+		const __m256 hi = _mm256_add_ps(hi0, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(r1 + 2 * x + 8), hi0), weightY));
+		const __m256 coefA = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 coefB = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+		const __m256i px = _mm256_loadu_si256((const __m256i *)(g + 4 * x));
+		const __m256i b = _mm256_and_si256(px, byteMask);
+		const __m256i gr = _mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask);
+		const __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask);
+		const __m256i lumaSum = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b, lumaB), _mm256_mullo_epi32(gr, lumaG)), _mm256_mullo_epi32(r, lumaR));
+		const __m256 luma = _mm256_mul_ps(_mm256_cvtepi32_ps(lumaSum), scale);
+
+		const __m256 q = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(coefA, luma), coefB), zero), one);
+		const __m256i v = binarize ? _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(q, half, _CMP_GT_OQ)), fullByte)
+					   : _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(q, full), half));
+
+		const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		_mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(words, words));
+	}
+
+	return x;
+}
+
+#elif defined(BGBLUR_PREPROCESS_NEON)
+
+static inline int applyRowNEON(const float *r0, const float *r1, float wy, const uint8_t *g, int width, bool binarize, float lumaScale, uint8_t *out)
+{
+	const float32x4_t weightY = vdupq_n_f32(wy), scale = vdupq_n_f32(lumaScale);
+	const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f), half = vdupq_n_f32(0.5f), full = vdupq_n_f32(255.0f);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		// val[0..3] = B, G, R, A of 8 pixels; the weighted sum fits 16 bits
+		const uint8x8x4_t px = vld4_u8(g + 4 * x);
+		const uint16x8_t lumaSum = vmlal_u8(vmlal_u8(vmull_u8(px.val[0], vdup_n_u8(GUIDE_LUMA_B)), px.val[1], vdup_n_u8(GUIDE_LUMA_G)), px.val[2], vdup_n_u8(GUIDE_LUMA_R));
+
+		uint16x4_t v[2];
+
+		for (int q = 0; q < 2; ++q)
+		{
+			// Deinterleaving loads: val[0] = a, val[1] = b
+			const float32x4x2_t c0 = vld2q_f32(r0 + 2 * (x + 4 * q)), c1 = vld2q_f32(r1 + 2 * (x + 4 * q));
+			const float32x4_t coefA = vaddq_f32(c0.val[0], vmulq_f32(vsubq_f32(c1.val[0], c0.val[0]), weightY));
+			const float32x4_t coefB = vaddq_f32(c0.val[1], vmulq_f32(vsubq_f32(c1.val[1], c0.val[1]), weightY));
+			const float32x4_t luma = vmulq_f32(vcvtq_f32_u32(q ? vmovl_high_u16(lumaSum) : vmovl_u16(vget_low_u16(lumaSum))), scale);
+			const float32x4_t value = vminq_f32(vmaxq_f32(vaddq_f32(vmulq_f32(coefA, luma), coefB), zero), one);
+
+			v[q] = binarize ? vmovn_u32(vcgtq_f32(value, half)) : vmovn_u32(vcvtq_u32_f32(vaddq_f32(vmulq_f32(value, full), half)));
+		}
+
+		vst1_u8(out + x, vmovn_u16(vcombine_u16(v[0], v[1])));
+	}
+
+	return x;
+}
+
+#endif
+
+void GuidedUpsampler::computeCoefficients(const cv::Mat &guideBGRA, const cv::Rect &contentRect, const cv::Mat &mask, int radius, float eps,
+					  cv::Mat &coefficients)
+{
+	cv::Rect content = contentRect & cv::Rect(0, 0, guideBGRA.cols, guideBGRA.rows);
+
+	if (content.empty())
+		content = cv::Rect(0, 0, guideBGRA.cols, guideBGRA.rows);
+
+	// Guide at mask resolution, both on a [0, 1] scale
+	cv::resize(guideBGRA(content), guideSmall, mask.size(), 0, 0, cv::INTER_AREA);
+	cv::cvtColor(guideSmall, guideGray, cv::COLOR_BGRA2GRAY);
+	guideGray.convertTo(guide, CV_32F, 1.0 / 255.0);
+	mask.convertTo(source, CV_32F, 1.0 / 255.0);
+
+	const cv::Size box(2 * radius + 1, 2 * radius + 1);
+
+	cv::boxFilter(guide, meanGuide, CV_32F, box);
+	cv::boxFilter(source, meanSource, CV_32F, box);
+	cv::multiply(guide, guide, product);
+	cv::boxFilter(product, corrGuide, CV_32F, box);
+	cv::multiply(guide, source, product);
+	cv::boxFilter(product, corrGuideSource, CV_32F, box);
+
+	// a = cov(I, p) / (var(I) + eps), b = mean(p) - a * mean(I), in one pass over the box means
+	a.create(mask.size(), CV_32FC1);
+	b.create(mask.size(), CV_32FC1);
+
+	for (int y = 0; y < mask.rows; ++y)
+	{
+		const float *mI = meanGuide.ptr<float>(y);
+		const float *mP = meanSource.ptr<float>(y);
+		const float *cI = corrGuide.ptr<float>(y);
+		const float *cIP = corrGuideSource.ptr<float>(y);
+		float *rowA = a.ptr<float>(y);
+		float *rowB = b.ptr<float>(y);
+
+		for (int x = 0; x < mask.cols; ++x)
+		{
+			const float variance = cI[x] - mI[x] * mI[x];
+			const float covariance = cIP[x] - mI[x] * mP[x];
+			rowA[x] = covariance / (variance + eps);
+			rowB[x] = mP[x] - rowA[x] * mI[x];
+		}
+	}
+
+	// Every pixel is covered by several windows; average their fits
+	cv::boxFilter(a, meanA, CV_32F, box);
+	cv::boxFilter(b, meanB, CV_32F, box);
+
+	const cv::Mat planes[2] = {meanA, meanB};
+	cv::merge(planes, 2, coefficients);
+}
+
+void GuidedUpsampler::apply(const cv::Mat &coefficients, const cv::Mat &guideBGRA, const cv::Rect &roi, bool binarize, cv::Mat &dst, TilePool &pool)
+{
+	// Row tiles over the whole frame, like MaskPostProcessor::processFullResMask: outside the ROI is filled, inside
+	//	applied. Output rows depend on two coefficient rows and their own guide row only, so there is no halo.
+	const bool partial = roi != cv::Rect(0, 0, dst.cols, dst.rows);
+	const int workers = (int)pool.workers();
+	const int tiles = pool.tileCount(dst.rows);
+
+	// Column table: pixel-center aligned, as cv::resize INTER_LINEAR
+	const double scaleX = (double)coefficients.cols / roi.width;
+	xOffsets.resize(roi.width);
+	xWeights.resize(roi.width);
+
+	for (int x = 0; x < roi.width; ++x)
+	{
+		const double fx = (x + 0.5) * scaleX - 0.5;
+		int sx = (int)std::floor(fx);
+		float weight = (float)(fx - sx);
+
+		if (sx < 0)
+			sx = 0, weight = 0.0f;
+
+		if (sx >= coefficients.cols - 1)
+			sx = coefficients.cols - 1, weight = 0.0f;
+
+		xOffsets[x] = sx;
+		xWeights[x] = weight;
+	}
+
+	rowBuffers.resize(2 * workers);
+
+	pool.run(tiles, [&](int tile, int worker) {
+		int y0, y1;
+		TilePool::tileRows(dst.rows, tiles, tile, y0, y1);
+
+		if (partial)
+			dst.rowRange(y0, y1).setTo(255);
+
+		const int roiY0 = std::max(y0, roi.y) - roi.y;
+		const int roiY1 = std::min(y1, roi.y + roi.height) - roi.y;
+
+		if (roiY0 < roiY1)
+			applyRows(coefficients, guideBGRA, roi, binarize, dst, roiY0, roiY1, &rowBuffers[2 * worker]);
+	});
+}
+
+void GuidedUpsampler::applyRows(const cv::Mat &coefficients, const cv::Mat &guideBGRA, const cv::Rect &roi, bool binarize, cv::Mat &dst, int y0, int y1,
+				std::vector<float> *rows)
+{
+	const int srcWidth = coefficients.cols, srcHeight = coefficients.rows;
+	const int width = roi.width;
+	const double scaleY = (double)srcHeight / roi.height;
+	const float lumaScale = 1.0f / (255.0f * 256.0f);
+
+	int cachedRows[2] = {-1, -1};
+
+	for (int i = 0; i < 2; ++i)
+		rows[i].resize(2 * width);
+
+#if defined(BGBLUR_PREPROCESS_X86)
+	const bool useAVX2 = cpuHasAVX2();
+#endif
+
+	auto interpolateRow = [&](int sy, std::vector<float> &out) {
+		const cv::Vec2f *s = coefficients.ptr<cv::Vec2f>(sy);
+		const int lastX = srcWidth - 1;
+
+		for (int x = 0; x < width; ++x)
+		{
+			const cv::Vec2f &c0 = s[xOffsets[x]];
+			const cv::Vec2f &c1 = s[std::min(xOffsets[x] + 1, lastX)];
+			const float w = xWeights[x];
+			out[2 * x] = c0[0] + (c1[0] - c0[0]) * w;
+			out[2 * x + 1] = c0[1] + (c1[1] - c0[1]) * w;
+		}
+	};
+
+	for (int y = y0; y < y1; ++y)
+	{
+		const double fy = (y + 0.5) * scaleY - 0.5;
+		int sy = (int)std::floor(fy);
+		float wy = (float)(fy - sy);
+
+		if (sy < 0)
+			sy = 0, wy = 0.0f;
+
+		if (sy >= srcHeight - 1)
+			sy = srcHeight - 1, wy = 0.0f;
+
+		const int sy1 = std::min(sy + 1, srcHeight - 1);
+
+		// Slide the two-row window, as in MaskPostProcessor::upsampleRows
+		if (cachedRows[0] != sy)
+		{
+			if (cachedRows[1] == sy)
+			{
+				std::swap(rows[0], rows[1]);
+				cachedRows[0] = sy;
+				cachedRows[1] = -1;
+			}
+			else
+			{
+				interpolateRow(sy, rows[0]);
+				cachedRows[0] = sy;
+			}
+		}
+
+		if (cachedRows[1] != sy1)
+		{
+			interpolateRow(sy1, rows[1]);
+			cachedRows[1] = sy1;
+		}
+
+		const float *r0 = rows[0].data();
+		const float *r1 = rows[1].data();
+		const uint8_t *g = guideBGRA.ptr<uint8_t>(roi.y + y) + 4 * roi.x;
+		uint8_t *out = dst.ptr<uint8_t>(roi.y + y) + roi.x;
+
+		// The coefficient rows above are interpolated once per source row; this runs for every output pixel
+		int x = 0;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+		if (useAVX2)
+			x = applyRowAVX2(r0, r1, wy, g, width, binarize, lumaScale, out);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+		x = applyRowNEON(r0, r1, wy, g, width, binarize, lumaScale, out);
+#endif
+
+		for (; x < width; ++x)
+		{
+			const float coefA = r0[2 * x] + (r1[2 * x] - r0[2 * x]) * wy;
+			const float coefB = r0[2 * x + 1] + (r1[2 * x + 1] - r0[2 * x + 1]) * wy;
+			const float luma = (float)(g[4 * x] * GUIDE_LUMA_B + g[4 * x + 1] * GUIDE_LUMA_G + g[4 * x + 2] * GUIDE_LUMA_R) * lumaScale;
+			const float q = std::min(std::max(coefA * luma + coefB, 0.0f), 1.0f);
+			out[x] = binarize ? (uint8_t)(q > 0.5f ? 255 : 0) : (uint8_t)(q * 255.0f + 0.5f);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+#include "TilePool.h"
+
+// Guide luma weights in 1/256 (BT.601, as cv::COLOR_BGRA2GRAY)
+#define GUIDE_LUMA_B 29
+#define GUIDE_LUMA_G 150
+#define GUIDE_LUMA_R 77
+
+/**
+ * Fast guided filter mask upsampling
+ * The guided filter fits the mask locally as a linear function of the frame's luma, q = a * I + b, so mask edges
+ * follow image edges instead of the network's pixel grid. The fast variant solves for a and b at network resolution,
+ * against the frame reduced to the mask size, and only upsamples the coefficients: the full-resolution work is a
+ * bilinear fetch of (a, b) and one multiply-add per pixel, either here (apply, with AVX2 / NEON row kernels as in
+ * Preprocess.h) or in the mask effect.
+ */
+class GuidedUpsampler
+{
+public:
+	// Coefficients (CV_32FC2: a, b) for mask (8-bit, 255 = background, covering contentRect of guideBGRA).
+	//	radius is the box radius in mask pixels, eps the regularization on the [0, 1] luma scale.
+	void computeCoefficients(const cv::Mat &guideBGRA, const cv::Rect &contentRect, const cv::Mat &mask, int radius, float eps, cv::Mat &coefficients);
+
+	// dst(roi) = a * luma(guideBGRA) + b, with (a, b) bilinearly upsampled to roi; guideBGRA and dst are frame aligned
+	//	and dst is already sized. Outside roi is background. Binarized at 0.5 when binarize is set. Runs in row tiles.
+	void apply(const cv::Mat &coefficients, const cv::Mat &guideBGRA, const cv::Rect &roi, bool binarize, cv::Mat &dst, TilePool &pool);
+
+private:
+	void applyRows(const cv::Mat &coefficients, const cv::Mat &guideBGRA, const cv::Rect &roi, bool binarize, cv::Mat &dst, int y0, int y1,
+		       std::vector<float> *rows);
+
+	cv::Mat guideSmall;
+	cv::Mat guideGray;
+	cv::Mat guide;
+	cv::Mat source;
+	cv::Mat product;
+	cv::Mat meanGuide;
+	cv::Mat meanSource;
+	cv::Mat corrGuide;
+	cv::Mat corrGuideSource;
+	cv::Mat a;
+	cv::Mat b;
+	cv::Mat meanA;
+	cv::Mat meanB;
+	std::vector<int> xOffsets;
+	std::vector<float> xWeights;
+	std::vector<std::vector<float>> rowBuffers; // two interleaved (a, b) rows per worker
+};
@@ -0,0 +1,206 @@
+#include "InferenceScheduler.h"
+
+#include <util\platform.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static size_t elementCount(const std::vector<int64_t> &dims)
+{
+	size_t count = 1;
+	for (int64_t d : dims)
+		count *= (size_t)std::max<int64_t>(d, 1);
+	return count;
+}
+
+/*static*/
+InferenceScheduler &InferenceScheduler::instance()
+{
+	// Never destroyed, like OrtRegistry: it only holds queues of sessions the registry owns, and their deleters call release()
+	static InferenceScheduler *scheduler = new InferenceScheduler();
+	return *scheduler;
+}
+
+/*static*/
+uint64_t InferenceScheduler::estimatedRunNs(const Queue &queue, size_t batchSize)
+{
+	// Per item, so the estimate errs long: batched runs scale sublinearly
+	return (uint64_t)(queue.runNsPerItem * (double)batchSize);
+}
+
+void InferenceScheduler::release(uint64_t sessionId)
+{
+	// The session's last user is gone, so nothing runs on or waits in its queue
+	std::lock_guard<std::mutex> guard(lock);
+	queues.erase(sessionId);
+}
+
+int InferenceScheduler::run(const std::shared_ptr<Ort::Session> &session, uint64_t sessionId, std::mutex &runLock, const char *inputName, const char *outputName, float *input, const std::vector<int64_t> &inputDims, float *output,
+			    const std::vector<int64_t> &outputDims, uint64_t deadlineNs)
+{
+	Request self;
+	self.input = input;
+	self.output = output;
+	self.deadlineNs = deadlineNs;
+
+	std::unique_lock<std::mutex> guard(lock);
+	Queue &queue = queues[sessionId];
+	queue.pending.push_back(&self);
+	changed.notify_all();
+
+	for (;;)
+	{
+		if (self.done)
+		{
+			if (self.error)
+				std::rethrow_exception(self.error);
+
+			return self.batchSize;
+		}
+
+		if (!self.taken && !queue.leaderActive)
+		{
+			// Lead the next batch: collect until the window closes, the batch is full, or waiting any longer would
+			//	make the earliest deadline in it unreachable
+			queue.leaderActive = true;
+
+			// Every instance on the session holds a reference to it (the registry only keeps a weak one), so a lone
+			//	holder has no one to wait for
+			const uint64_t window = session.use_count() > 1 ? (uint64_t)INFERENCE_BATCH_WINDOW_MS * 1000000ULL : 0;
+			const uint64_t windowEnd = os_gettime_ns() + window;
+
+			for (;;)
+			{
+				uint64_t earliestDeadline = UINT64_MAX;
+				for (const Request *request : queue.pending)
+					earliestDeadline = std::min(earliestDeadline, request->deadlineNs);
+
+				const size_t size = queue.pending.size();
+				const uint64_t runNs = estimatedRunNs(queue, std::min(size + 1, (size_t)INFERENCE_MAX_BATCH));
+				const uint64_t until = std::min(windowEnd, earliestDeadline > runNs ? earliestDeadline - runNs : 0);
+				const uint64_t now = os_gettime_ns();
+
+				if (size >= (size_t)INFERENCE_MAX_BATCH || now >= until)
+					break;
+
+				changed.wait_for(guard, std::chrono::nanoseconds(until - now));
+			}
+
+			// The leader always rides in its own batch
+			std::vector<Request *> batch{&self};
+			for (Request *request : queue.pending)
+			{
+				if (request != &self && batch.size() < (size_t)INFERENCE_MAX_BATCH)
+					batch.push_back(request);
+			}
+
+			for (Request *request : batch)
+			{
+				request->taken = true;
+				queue.pending.erase(std::find(queue.pending.begin(), queue.pending.end(), request));
+			}
+
+			guard.unlock();
+
+			std::exception_ptr error;
+			const uint64_t runStart = os_gettime_ns();
+
+			try
+			{
+				runBatch(*session, runLock, inputName, outputName, queue, batch, inputDims, outputDims);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			const double perItem = (double)(os_gettime_ns() - runStart) / (double)batch.size();
+
+			guard.lock();
+
+			if (!error)
+				queue.runNsPerItem = queue.runNsPerItem > 0.0 ? queue.runNsPerItem + (perItem - queue.runNsPerItem) * INFERENCE_RUN_EMA_ALPHA : perItem;
+
+			for (Request *request : batch)
+			{
+				request->done = true;
+				request->batchSize = (int)batch.size();
+				request->error = error;
+			}
+
+			queue.leaderActive = false;
+			changed.notify_all();
+			continue;
+		}
+
+		if (self.taken)
+		{
+			changed.wait(guard);
+			continue;
+		}
+
+		// Queued behind a batch in flight: at the deadline, stop waiting for batching and run alone
+		const uint64_t runNs = estimatedRunNs(queue, 1);
+		const uint64_t until = deadlineNs > runNs ? deadlineNs - runNs : 0;
+		const uint64_t now = os_gettime_ns();
+
+		if (now >= until)
+		{
+			queue.pending.erase(std::find(queue.pending.begin(), queue.pending.end(), &self));
+			guard.unlock();
+
+			// A single request runs straight on its own buffers, so it doesn't touch the queue's batch buffers. The run
+			//	lock in runBatch queues it behind the batch in flight instead of running the session concurrently.
+			runBatch(*session, runLock, inputName, outputName, queue, {&self}, inputDims, outputDims);
+			return 1;
+		}
+
+		changed.wait_for(guard, std::chrono::nanoseconds(until - now));
+	}
+}
+
+/*static*/
+void InferenceScheduler::runBatch(Ort::Session &session, std::mutex &runLock, const char *inputName, const char *outputName, Queue &queue, const std::vector<Request *> &batch,
+				  const std::vector<int64_t> &inputDims, const std::vector<int64_t> &outputDims)
+{
+	const size_t count = batch.size();
+	const size_t inputSize = elementCount(inputDims);
+	const size_t outputSize = elementCount(outputDims);
+
+	std::vector<int64_t> batchInputDims = inputDims;
+	std::vector<int64_t> batchOutputDims = outputDims;
+	batchInputDims[0] = (int64_t)count;
+	batchOutputDims[0] = (int64_t)count;
+
+	float *inputData = batch[0]->input;
+	float *outputData = batch[0]->output;
+
+	if (count > 1)
+	{
+		queue.batchInput.resize(count * inputSize);
+		queue.batchOutput.resize(count * outputSize);
+
+		for (size_t i = 0; i < count; ++i)
+			std::memcpy(queue.batchInput.data() + i * inputSize, batch[i]->input, inputSize * sizeof(float));
+
+		inputData = queue.batchInput.data();
+		outputData = queue.batchOutput.data();
+	}
+
+	Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtDeviceAllocator, OrtMemType::OrtMemTypeDefault);
+	Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memInfo, inputData, count * inputSize, batchInputDims.data(), batchInputDims.size());
+	Ort::Value outputTensor = Ort::Value::CreateTensor<float>(memInfo, outputData, count * outputSize, batchOutputDims.data(), batchOutputDims.size());
+
+	{
+		// Instances running the session outside the scheduler take the same lock
+		std::lock_guard<std::mutex> guard(runLock);
+		session.Run(Ort::RunOptions{nullptr}, &inputName, &inputTensor, 1, &outputName, &outputTensor, 1);
+	}
+
+	if (count > 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+			std::memcpy(batch[i]->output, queue.batchOutput.data() + i * outputSize, outputSize * sizeof(float));
+	}
+}
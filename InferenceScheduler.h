@@ -0,0 +1,70 @@
+#pragma once
+
+#include <onnxruntime_cxx_api.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Longest a batch waits for more requests to join, and the most requests it stacks
+#define INFERENCE_BATCH_WINDOW_MS 4
+#define INFERENCE_MAX_BATCH 8
+#define INFERENCE_RUN_EMA_ALPHA 0.1
+
+/**
+ * Cross-instance batched inference
+ * Filter instances sharing a session (see OrtRegistry) hand their batch-1 requests to the scheduler. The first request
+ * for a session leads: it waits a short window for requests from other instances, stacks their inputs into one
+ * batch tensor along the (dynamic) batch dimension, runs once and scatters the outputs back. A leader holding the only
+ * reference to the session skips the window, since no other instance can join. The window never extends
+ * past the point where the earliest deadline in the batch could still be met, given the measured run time, and a
+ * request still waiting behind another batch at its deadline runs on its own. Single input / single output stateless
+ * models only; everything else runs as before.
+ */
+class InferenceScheduler
+{
+public:
+	static InferenceScheduler &instance();
+
+	// Runs input (shaped inputDims, batch 1) into output (shaped outputDims, batch 1) by deadlineNs (os_gettime_ns
+	//	time) if possible. sessionId and runLock are the session's registry id and run lock, the lock is held around each Run. Returns the batch size the
+	//	request ran in. Rethrows a failed run's exception.
+	int run(const std::shared_ptr<Ort::Session> &session, uint64_t sessionId, std::mutex &runLock, const char *inputName, const char *outputName, float *input, const std::vector<int64_t> &inputDims, float *output,
+		const std::vector<int64_t> &outputDims, uint64_t deadlineNs);
+
+	// Drops the queue of a session being destroyed; called by OrtRegistry
+	void release(uint64_t sessionId);
+
+private:
+	struct Request
+	{
+		float *input = nullptr;
+		float *output = nullptr;
+		uint64_t deadlineNs = 0;
+		bool taken = false;
+		bool done = false;
+		int batchSize = 0;
+		std::exception_ptr error;
+	};
+
+	struct Queue
+	{
+		std::vector<Request *> pending;
+		bool leaderActive = false;
+		double runNsPerItem = 0.0; // EMA
+		std::vector<float> batchInput;
+		std::vector<float> batchOutput;
+	};
+
+	static void runBatch(Ort::Session &session, std::mutex &runLock, const char *inputName, const char *outputName, Queue &queue, const std::vector<Request *> &batch,
+			     const std::vector<int64_t> &inputDims, const std::vector<int64_t> &outputDims);
+	static uint64_t estimatedRunNs(const Queue &queue, size_t batchSize);
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::map<uint64_t, Queue> queues; // guarded by lock, by registry session id
+};
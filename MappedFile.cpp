@@ -0,0 +1,64 @@
+#include "MappedFile.h"
+
+#include <windows.h>
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::wstring &path)
+{
+	close();
+
+	HANDLE fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	file = fileHandle;
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (!mapping)
+	{
+		close();
+		return false;
+	}
+
+	view = MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (!view)
+	{
+		close();
+		return false;
+	}
+
+	length = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view)
+		UnmapViewOfFile(view);
+
+	if (mapping)
+		CloseHandle((HANDLE)mapping);
+
+	if (file)
+		CloseHandle((HANDLE)file);
+
+	view = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	length = 0;
+}
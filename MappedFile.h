@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only memory-mapped file
+ * Every mapping of the same file shares its physical pages with the page cache, so a model mapped once and handed to
+ * ONNX Runtime by address is resident once no matter how many sessions read it. Opened shareable for deletion so
+ * ModelCache can replace entries that running sessions still map.
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	~MappedFile();
+
+	bool open(const std::wstring &path);
+	void close();
+
+	const void *data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	void *file = nullptr;    // HANDLE
+	void *mapping = nullptr; // HANDLE
+	const void *view = nullptr;
+	size_t length = 0;
+};
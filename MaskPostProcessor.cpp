@@ -0,0 +1,849 @@
+#include "MaskPostProcessor.h"
+#include "Preprocess.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+static int smoothKernelSize(float smoothContour)
+{
+	int k = (int)(3 + 11 * smoothContour);
+	if ((k & 1) == 0)
+		++k;
+	return k;
+}
+
+// Weight of the new value (0..1) for a pixel that changed by d levels
+static double temporalNewWeight(const MaskPostParams &params, double d)
+{
+	const double still = 1.0 - params.temporalSmoothFactor;
+	const double t = std::clamp((d - MASK_TEMPORAL_STILL_LEVEL) / (double)(MASK_TEMPORAL_MOTION_LEVEL - MASK_TEMPORAL_STILL_LEVEL), 0.0, 1.0);
+	return still + (1.0 - still) * t;
+}
+
+// Soft masks are inverted (255 = background), so round(v * 255) < level <=> soft > 255 - level
+static uint8_t thresholdLevel(const MaskPostParams &params)
+{
+	return (uint8_t)(params.threshold * 255.0f);
+}
+
+// Row kernels. Each returns how far it got, and the scalar loop in its caller finishes the row from there; the AVX2
+//	paths are only taken after the runtime CPU check, see Preprocess.h. Results match the scalar code exactly.
+#if defined(BGBLUR_PREPROCESS_X86)
+
+// 8 values in 0..255 (one per 32-bit lane) to 8 bytes
+BGBLUR_TARGET_AVX2 static inline void storeBytesAVX2(uint8_t *dst, __m256i v)
+{
+	const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(words, words));
+}
+
+// 8 values in 0..65535 (one per 32-bit lane) to 8 words
+BGBLUR_TARGET_AVX2 static inline void storeWordsAVX2(uint16_t *dst, __m256i v)
+{
+	_mm_storeu_si128((__m128i *)dst, _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+BGBLUR_TARGET_AVX2 static inline int thresholdSoftRowAVX2(const float *src, int width, uint8_t *dst)
+{
+	const __m256 scale = _mm256_set1_ps(255.0f), zero = _mm256_setzero_ps(), half = _mm256_set1_ps(0.5f);
+	const __m256i full = _mm256_set1_epi32(255);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + x), scale), zero), scale);
+		storeBytesAVX2(dst + x, _mm256_sub_epi32(full, _mm256_cvttps_epi32(_mm256_add_ps(v, half))));
+	}
+
+	return x;
+}
+
+BGBLUR_TARGET_AVX2 static inline int thresholdBinaryRowAVX2(const float *src, int width, float limit, uint8_t *dst)
+{
+	const __m256 scale = _mm256_set1_ps(255.0f), limits = _mm256_set1_ps(limit);
+	const __m256i full = _mm256_set1_epi32(255);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m256 below = _mm256_cmp_ps(_mm256_mul_ps(_mm256_loadu_ps(src + x), scale), limits, _CMP_LT_OQ);
+		storeBytesAVX2(dst + x, _mm256_and_si256(_mm256_castps_si256(below), full));
+	}
+
+	return x;
+}
+
+BGBLUR_TARGET_AVX2 static inline int temporalRowAVX2(uint8_t *m, uint16_t *h, int width, const int *weights, bool binarize, int binarizeAbove)
+{
+	const __m256i round = _mm256_set1_epi32(128), one = _mm256_set1_epi32(256), above = _mm256_set1_epi32(binarizeAbove), full = _mm256_set1_epi32(255);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m256i mask = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(m + x)));
+		const __m256i history = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(h + x)));
+		const __m256i previous = _mm256_srli_epi32(_mm256_add_epi32(history, round), 8);
+		const __m256i w = _mm256_i32gather_epi32(weights, _mm256_abs_epi32(_mm256_sub_epi32(mask, previous)), 4);
+
+		const __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(history, _mm256_sub_epi32(one, w)), _mm256_mullo_epi32(_mm256_slli_epi32(mask, 8), w));
+		const __m256i blended = _mm256_srli_epi32(_mm256_add_epi32(sum, round), 8);
+		storeWordsAVX2(h + x, blended);
+
+		__m256i v = _mm256_srli_epi32(_mm256_add_epi32(blended, round), 8);
+
+		if (binarize)
+			v = _mm256_and_si256(_mm256_cmpgt_epi32(v, above), full);
+
+		storeBytesAVX2(m + x, v);
+	}
+
+	return x;
+}
+
+// Horizontal bilinear pass: one 32-bit gather per pixel fetches both source taps. Stops where a gather would read
+//	past the end of the source row.
+BGBLUR_TARGET_AVX2 static inline int interpolateRowAVX2(const uint8_t *s, int srcWidth, const int *xOffsets, const uint16_t *xWeights, int dstWidth, uint16_t *out)
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xFF), one = _mm256_set1_epi32(256);
+
+	int x = 0;
+
+	for (; x + 8 <= dstWidth && xOffsets[x + 7] + 4 <= srcWidth; x += 8)
+	{
+		const __m256i taps = _mm256_i32gather_epi32((const int *)s, _mm256_loadu_si256((const __m256i *)(xOffsets + x)), 1);
+		const __m256i left = _mm256_and_si256(taps, byteMask);
+		const __m256i right = _mm256_and_si256(_mm256_srli_epi32(taps, 8), byteMask);
+		const __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(xWeights + x)));
+
+		storeWordsAVX2(out + x, _mm256_add_epi32(_mm256_mullo_epi32(left, _mm256_sub_epi32(one, w)), _mm256_mullo_epi32(right, w)));
+	}
+
+	return x;
+}
+
+// Vertical bilinear pass between two interpolated rows, optionally binarized at > 128
+BGBLUR_TARGET_AVX2 static inline int blendRowsAVX2(const uint16_t *r0, const uint16_t *r1, int width, uint32_t w0, uint32_t w1, bool binarize, uint8_t *out)
+{
+	const __m256i weight0 = _mm256_set1_epi32((int)w0), weight1 = _mm256_set1_epi32((int)w1);
+	const __m256i round = _mm256_set1_epi32(32768), limit = _mm256_set1_epi32(128 * 65536 + 32767), full = _mm256_set1_epi32(255);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m256i a = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(r0 + x)));
+		const __m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(r1 + x)));
+		const __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(a, weight0), _mm256_mullo_epi32(b, weight1));
+
+		if (binarize)
+			storeBytesAVX2(out + x, _mm256_and_si256(_mm256_cmpgt_epi32(sum, limit), full));
+		else
+			storeBytesAVX2(out + x, _mm256_srli_epi32(_mm256_add_epi32(sum, round), 16));
+	}
+
+	return x;
+}
+
+BGBLUR_TARGET_AVX2 static inline int maxRowAVX2(uint8_t *d, const uint8_t *s, int width)
+{
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32)
+		_mm256_storeu_si256((__m256i *)(d + x), _mm256_max_epu8(_mm256_loadu_si256((const __m256i *)(d + x)), _mm256_loadu_si256((const __m256i *)(s + x))));
+
+	return x;
+}
+
+#elif defined(BGBLUR_PREPROCESS_NEON)
+
+static inline int thresholdSoftRowNEON(const float *src, int width, uint8_t *dst)
+{
+	const float32x4_t scale = vdupq_n_f32(255.0f), zero = vdupq_n_f32(0.0f), half = vdupq_n_f32(0.5f);
+	const uint32x4_t full = vdupq_n_u32(255);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		uint16x4_t v[2];
+
+		for (int q = 0; q < 2; ++q)
+		{
+			const float32x4_t f = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(src + x + q * 4), scale), zero), scale);
+			v[q] = vmovn_u32(vsubq_u32(full, vcvtq_u32_f32(vaddq_f32(f, half))));
+		}
+
+		vst1_u8(dst + x, vmovn_u16(vcombine_u16(v[0], v[1])));
+	}
+
+	return x;
+}
+
+static inline int thresholdBinaryRowNEON(const float *src, int width, float limit, uint8_t *dst)
+{
+	const float32x4_t scale = vdupq_n_f32(255.0f), limits = vdupq_n_f32(limit);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const uint16x4_t lo = vmovn_u32(vcltq_f32(vmulq_f32(vld1q_f32(src + x), scale), limits));
+		const uint16x4_t hi = vmovn_u32(vcltq_f32(vmulq_f32(vld1q_f32(src + x + 4), scale), limits));
+		vst1_u8(dst + x, vmovn_u16(vcombine_u16(lo, hi)));
+	}
+
+	return x;
+}
+
+// No gather: the weight comes from two byte table lookups (low and high byte) indexed by the change clamped to the
+//	ramp between the still and motion levels, where the scalar table is constant outside it
+static inline int temporalRowNEON(uint8_t *m, uint16_t *h, int width, const uint8x16x4_t &weightLow, const uint8x16x4_t &weightHigh, bool binarize,
+				  uint8_t binarizeAbove)
+{
+	const uint8x16_t still = vdupq_n_u8(MASK_TEMPORAL_STILL_LEVEL), ramp = vdupq_n_u8(MASK_TEMPORAL_MOTION_LEVEL - MASK_TEMPORAL_STILL_LEVEL);
+	const uint8x16_t above = vdupq_n_u8(binarizeAbove);
+	const uint16x8_t one = vdupq_n_u16(256);
+
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const uint8x16_t mask = vld1q_u8(m + x);
+		const uint16x8_t history[2] = {vld1q_u16(h + x), vld1q_u16(h + x + 8)};
+		const uint8x16_t previous = vcombine_u8(vrshrn_n_u16(history[0], 8), vrshrn_n_u16(history[1], 8));
+		const uint8x16_t step = vminq_u8(vqsubq_u8(vabdq_u8(mask, previous), still), ramp);
+		const uint8x16_t low = vqtbl4q_u8(weightLow, step), high = vqtbl4q_u8(weightHigh, step);
+
+		uint8x8_t v[2];
+
+		for (int q = 0; q < 2; ++q)
+		{
+			const uint16x8_t w = vorrq_u16(vmovl_u8(q ? vget_high_u8(low) : vget_low_u8(low)), vshll_n_u8(q ? vget_high_u8(high) : vget_low_u8(high), 8));
+			const uint16x8_t keep = vsubq_u16(one, w);
+			const uint16x8_t value = vshll_n_u8(q ? vget_high_u8(mask) : vget_low_u8(mask), 8);
+
+			const uint32x4_t sumLow = vmlal_u16(vmull_u16(vget_low_u16(history[q]), vget_low_u16(keep)), vget_low_u16(value), vget_low_u16(w));
+			const uint32x4_t sumHigh = vmlal_high_u16(vmull_high_u16(history[q], keep), value, w);
+			const uint16x8_t blended = vcombine_u16(vrshrn_n_u32(sumLow, 8), vrshrn_n_u32(sumHigh, 8));
+
+			vst1q_u16(h + x + q * 8, blended);
+			v[q] = vrshrn_n_u16(blended, 8);
+		}
+
+		uint8x16_t out = vcombine_u8(v[0], v[1]);
+
+		if (binarize)
+			out = vcgtq_u8(out, above);
+
+		vst1q_u8(m + x, out);
+	}
+
+	return x;
+}
+
+// Vertical bilinear pass between two interpolated rows, optionally binarized at > 128. The horizontal pass stays
+//	scalar here: it is a per-pixel gather NEON has no instruction for, and it only runs once per source row.
+static inline int blendRowsNEON(const uint16_t *r0, const uint16_t *r1, int width, uint32_t w0, uint32_t w1, bool binarize, uint8_t *out)
+{
+	const uint16x4_t weight0 = vdup_n_u16((uint16_t)w0), weight1 = vdup_n_u16((uint16_t)w1);
+	const uint32x4_t limit = vdupq_n_u32(128u * 65536u + 32767u);
+
+	int x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const uint16x8_t a = vld1q_u16(r0 + x), b = vld1q_u16(r1 + x);
+		const uint32x4_t sumLow = vmlal_u16(vmull_u16(vget_low_u16(a), weight0), vget_low_u16(b), weight1);
+		const uint32x4_t sumHigh = vmlal_u16(vmull_u16(vget_high_u16(a), weight0), vget_high_u16(b), weight1);
+
+		uint16x8_t v;
+
+		if (binarize)
+			v = vcombine_u16(vmovn_u32(vcgtq_u32(sumLow, limit)), vmovn_u32(vcgtq_u32(sumHigh, limit)));
+		else
+			v = vcombine_u16(vrshrn_n_u32(sumLow, 16), vrshrn_n_u32(sumHigh, 16));
+
+		vst1_u8(out + x, vmovn_u16(v));
+	}
+
+	return x;
+}
+
+static inline int maxRowNEON(uint8_t *d, const uint8_t *s, int width)
+{
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16)
+		vst1q_u8(d + x, vmaxq_u8(vld1q_u8(d + x), vld1q_u8(s + x)));
+
+	return x;
+}
+
+#endif
+
+// d = max(d, s) over a row, the inner step of both dilation passes
+static inline void maxRow(uint8_t *d, const uint8_t *s, int width)
+{
+	int x = 0;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+	if (cpuHasAVX2())
+		x = maxRowAVX2(d, s, width);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+	x = maxRowNEON(d, s, width);
+#endif
+
+	for (; x < width; ++x)
+		d[x] = std::max(d[x], s[x]);
+}
+
+/*static*/
+void MaskPostProcessor::thresholdPass(const cv::Mat &outputF32, const MaskPostParams &params, cv::Mat &mask)
+{
+	CV_Assert(outputF32.type() == CV_32FC1);
+
+	mask.create(outputF32.size(), CV_8UC1);
+
+	const int width = outputF32.cols;
+	const bool soft = !params.enableThreshold || temporalEnabled(params);
+
+	// round(v * 255) < level  <=>  v * 255 < level - 0.5, so the threshold needs no rounding at all
+	const int level = thresholdLevel(params);
+	const float limit = (float)level - 0.5f;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+	const bool useAVX2 = cpuHasAVX2();
+#endif
+
+	for (int y = 0; y < outputF32.rows; ++y)
+	{
+		const float *src = outputF32.ptr<float>(y);
+		uint8_t *dst = mask.ptr<uint8_t>(y);
+		int x = 0;
+
+		if (soft)
+		{
+#if defined(BGBLUR_PREPROCESS_X86)
+			if (useAVX2)
+				x = thresholdSoftRowAVX2(src, width, dst);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+			x = thresholdSoftRowNEON(src, width, dst);
+#endif
+
+			for (; x < width; ++x)
+			{
+				const float v = std::min(std::max(src[x] * 255.0f, 0.0f), 255.0f);
+				dst[x] = (uint8_t)(255 - (int)(v + 0.5f));
+			}
+		}
+		else if (level > 0)
+		{
+#if defined(BGBLUR_PREPROCESS_X86)
+			if (useAVX2)
+				x = thresholdBinaryRowAVX2(src, width, limit, dst);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+			x = thresholdBinaryRowNEON(src, width, limit, dst);
+#endif
+
+			for (; x < width; ++x)
+				dst[x] = src[x] * 255.0f < limit ? 255 : 0;
+		}
+		else
+		{
+			std::fill(dst, dst + width, (uint8_t)0);
+		}
+	}
+}
+
+/*static*/
+void MaskPostProcessor::temporalPass(cv::Mat &mask, cv::Mat &history, const MaskPostParams &params)
+{
+	const int width = mask.cols;
+	const bool binarize = params.enableThreshold;
+	const int binarizeAbove = 255 - thresholdLevel(params);
+
+	// No usable history (first frame, size change): start it from this mask
+	if (history.size() != mask.size() || history.type() != CV_16UC1)
+	{
+		history.create(mask.size(), CV_16UC1);
+		mask.convertTo(history, CV_16U, 256.0);
+	}
+
+	// New value weight in 1/256 steps by per-pixel change, so the inner loop is a lookup and a multiply-add
+	int weights[256];
+	for (int d = 0; d < 256; ++d)
+		weights[d] = (int)std::lround(temporalNewWeight(params, d) * 256.0);
+
+#if defined(BGBLUR_PREPROCESS_X86)
+	const bool useAVX2 = cpuHasAVX2();
+#elif defined(BGBLUR_PREPROCESS_NEON)
+	static_assert(MASK_TEMPORAL_MOTION_LEVEL - MASK_TEMPORAL_STILL_LEVEL < 64, "temporal weight ramp must fit a 64 byte table");
+
+	uint8_t rampLow[64] = {}, rampHigh[64] = {};
+	for (int i = 0; i <= MASK_TEMPORAL_MOTION_LEVEL - MASK_TEMPORAL_STILL_LEVEL; ++i)
+	{
+		rampLow[i] = (uint8_t)(weights[MASK_TEMPORAL_STILL_LEVEL + i] & 0xFF);
+		rampHigh[i] = (uint8_t)(weights[MASK_TEMPORAL_STILL_LEVEL + i] >> 8);
+	}
+
+	const uint8x16x4_t weightLow = {{vld1q_u8(rampLow), vld1q_u8(rampLow + 16), vld1q_u8(rampLow + 32), vld1q_u8(rampLow + 48)}};
+	const uint8x16x4_t weightHigh = {{vld1q_u8(rampHigh), vld1q_u8(rampHigh + 16), vld1q_u8(rampHigh + 32), vld1q_u8(rampHigh + 48)}};
+#endif
+
+	for (int y = 0; y < mask.rows; ++y)
+	{
+		uint8_t *m = mask.ptr<uint8_t>(y);
+		uint16_t *h = history.ptr<uint16_t>(y);
+		int x = 0;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+		if (useAVX2)
+			x = temporalRowAVX2(m, h, width, weights, binarize, binarizeAbove);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+		x = temporalRowNEON(m, h, width, weightLow, weightHigh, binarize, (uint8_t)binarizeAbove);
+#endif
+
+		for (; x < width; ++x)
+		{
+			const int previous = (h[x] + 128) >> 8;
+			const int w = weights[std::abs((int)m[x] - previous)];
+			const int blended = (h[x] * (256 - w) + (m[x] << 8) * w + 128) >> 8;
+
+			h[x] = (uint16_t)blended;
+
+			const int v = (blended + 128) >> 8;
+			m[x] = binarize ? (v > binarizeAbove ? 255 : 0) : (uint8_t)v;
+		}
+	}
+}
+
+void MaskPostProcessor::remapHistory(cv::Mat &history, const cv::Rect &historyRoi, const cv::Mat &mask, const cv::Rect &roi)
+{
+	if (history.empty() || historyRoi.empty() || roi.empty())
+	{
+		history.release();
+		return;
+	}
+
+	// Frame x of mask pixel x is roi.x + (x + 0.5) * roi.width / mask.cols; invert that for the history grid
+	const double scaleX = (double)roi.width / mask.cols, historyScaleX = (double)historyRoi.width / history.cols;
+	const double scaleY = (double)roi.height / mask.rows, historyScaleY = (double)historyRoi.height / history.rows;
+	const cv::Matx23d toHistory(scaleX / historyScaleX, 0.0, (roi.x - historyRoi.x + 0.5 * scaleX) / historyScaleX - 0.5, 0.0, scaleY / historyScaleY,
+				    (roi.y - historyRoi.y + 0.5 * scaleY) / historyScaleY - 0.5);
+
+	// Transparent border: where the old crop has nothing, the values seeded from the mask stay
+	mask.convertTo(remappedHistory, history.type(), history.type() == CV_16UC1 ? 256.0 : 1.0);
+	cv::warpAffine(history, remappedHistory, toHistory, remappedHistory.size(), cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_TRANSPARENT);
+	std::swap(history, remappedHistory);
+}
+
+void MaskPostProcessor::filterComponents(cv::Mat &mask, double minAreaFraction)
+{
+	// Same result as drawing the external contours above the area threshold filled: holes and anything nested in a
+	//	kept shape end up foreground, everything else background.
+
+	// 1. Background regions (4-connected, the dual of 8-connected foreground). Only those touching the border are
+	//	outside every external contour; the rest are holes.
+	cv::compare(mask, cv::Scalar(0), background, cv::CMP_EQ);
+	const int backgroundCount = cv::connectedComponentsWithStats(background, labels, stats, centroids, 4, CV_32S);
+
+	lut.assign(backgroundCount, 255);
+
+	for (int i = 1; i < backgroundCount; ++i)
+	{
+		const int *stat = stats.ptr<int>(i);
+		const bool touchesBorder = stat[cv::CC_STAT_LEFT] == 0 || stat[cv::CC_STAT_TOP] == 0 || stat[cv::CC_STAT_LEFT] + stat[cv::CC_STAT_WIDTH] == mask.cols ||
+					   stat[cv::CC_STAT_TOP] + stat[cv::CC_STAT_HEIGHT] == mask.rows;
+		lut[i] = touchesBorder ? 0 : 255;
+	}
+
+	filled.create(mask.size(), CV_8UC1);
+
+	for (int y = 0; y < mask.rows; ++y)
+	{
+		const int *label = labels.ptr<int>(y);
+		uint8_t *dst = filled.ptr<uint8_t>(y);
+
+		for (int x = 0; x < mask.cols; ++x)
+			dst[x] = lut[label[x]];
+	}
+
+	// 2. Filled shapes (8-connected). contourArea runs through the boundary pixel centers, so it is about half a
+	//	pixel smaller all around than the pixel count; the bounding box term corrects for that.
+	const int shapeCount = cv::connectedComponentsWithStats(filled, labels, stats, centroids, 8, CV_32S);
+	const double areaThreshold = (double)mask.total() * minAreaFraction;
+
+	lut.assign(shapeCount, 0);
+
+	for (int i = 1; i < shapeCount; ++i)
+	{
+		const int *stat = stats.ptr<int>(i);
+		const double area = (double)stat[cv::CC_STAT_AREA] - stat[cv::CC_STAT_WIDTH] - stat[cv::CC_STAT_HEIGHT] + 1;
+		lut[i] = area > areaThreshold ? 255 : 0;
+	}
+
+	for (int y = 0; y < mask.rows; ++y)
+	{
+		const int *label = labels.ptr<int>(y);
+		uint8_t *dst = mask.ptr<uint8_t>(y);
+
+		for (int x = 0; x < mask.cols; ++x)
+			dst[x] = lut[label[x]];
+	}
+}
+
+void MaskPostProcessor::prepareUpsample(const cv::Size &srcSize, const cv::Size &dstSize)
+{
+	// Bilinear with 8-bit fractional weights and pixel-center alignment (as cv::resize INTER_LINEAR)
+	const double scaleX = (double)srcSize.width / dstSize.width;
+
+	xOffsets.resize(dstSize.width);
+	xWeights.resize(dstSize.width);
+
+	for (int x = 0; x < dstSize.width; ++x)
+	{
+		const double fx = (x + 0.5) * scaleX - 0.5;
+		int sx = (int)std::floor(fx);
+		int weight = (int)std::lround((fx - sx) * 256.0);
+
+		if (sx < 0)
+			sx = 0, weight = 0;
+
+		if (sx >= srcSize.width - 1)
+			sx = srcSize.width - 1, weight = 0;
+
+		xOffsets[x] = sx;
+		xWeights[x] = (uint16_t)weight;
+	}
+}
+
+void MaskPostProcessor::upsampleRows(const cv::Mat &src, cv::Mat &dst, int y0, int y1, bool binarize, std::vector<uint16_t> *rows)
+{
+	// Rows [y0, y1) of dst only; each output row depends on two source rows and nothing else, so tiles need no halo.
+	//	Each source row pair is interpolated horizontally once and reused by every output row between them.
+
+	const int srcWidth = src.cols, srcHeight = src.rows;
+	const int dstWidth = dst.cols, dstHeight = dst.rows;
+	const double scaleY = (double)srcHeight / dstHeight;
+
+	int cachedRows[2] = {-1, -1};
+
+	for (int i = 0; i < 2; ++i)
+		rows[i].resize(dstWidth);
+
+#if defined(BGBLUR_PREPROCESS_X86)
+	const bool useAVX2 = cpuHasAVX2();
+#endif
+
+	auto interpolateRow = [&](int sy, std::vector<uint16_t> &out) {
+		const uint8_t *s = src.ptr<uint8_t>(sy);
+		const int lastX = srcWidth - 1;
+		int x = 0;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+		if (useAVX2)
+			x = interpolateRowAVX2(s, srcWidth, xOffsets.data(), xWeights.data(), dstWidth, out.data());
+#endif
+
+		for (; x < dstWidth; ++x)
+		{
+			const int sx = xOffsets[x];
+			const int w = xWeights[x];
+			out[x] = (uint16_t)(s[sx] * (256 - w) + s[std::min(sx + 1, lastX)] * w);
+		}
+	};
+
+	for (int y = y0; y < y1; ++y)
+	{
+		const double fy = (y + 0.5) * scaleY - 0.5;
+		int sy = (int)std::floor(fy);
+		int wy = (int)std::lround((fy - sy) * 256.0);
+
+		if (sy < 0)
+			sy = 0, wy = 0;
+
+		if (sy >= srcHeight - 1)
+			sy = srcHeight - 1, wy = 0;
+
+		const int sy1 = std::min(sy + 1, srcHeight - 1);
+
+		// Slide the two-row window; upsampling mostly reuses both rows
+		if (cachedRows[0] != sy)
+		{
+			if (cachedRows[1] == sy)
+			{
+				std::swap(rows[0], rows[1]);
+				cachedRows[0] = sy;
+				cachedRows[1] = -1;
+			}
+			else
+			{
+				interpolateRow(sy, rows[0]);
+				cachedRows[0] = sy;
+			}
+		}
+
+		if (cachedRows[1] != sy1)
+		{
+			interpolateRow(sy1, rows[1]);
+			cachedRows[1] = sy1;
+		}
+
+		const uint16_t *r0 = rows[0].data();
+		const uint16_t *r1 = rows[1].data();
+		uint8_t *out = dst.ptr<uint8_t>(y);
+
+		// value = (r0 * (256 - wy) + r1 * wy) / 65536
+		const uint32_t w0 = (uint32_t)(256 - wy), w1 = (uint32_t)wy;
+		int x = 0;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+		if (useAVX2)
+			x = blendRowsAVX2(r0, r1, dstWidth, w0, w1, binarize, out);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+		x = blendRowsNEON(r0, r1, dstWidth, w0, w1, binarize, out);
+#endif
+
+		if (binarize)
+		{
+			// > 128 without the divide: rounds to 129 or more above this
+			const uint32_t limit = 128u * 65536u + 32767u;
+
+			for (; x < dstWidth; ++x)
+				out[x] = (uint32_t)r0[x] * w0 + (uint32_t)r1[x] * w1 > limit ? 255 : 0;
+		}
+		else
+		{
+			for (; x < dstWidth; ++x)
+				out[x] = (uint8_t)(((uint32_t)r0[x] * w0 + (uint32_t)r1[x] * w1 + 32768u) >> 16);
+		}
+	}
+}
+
+/*static*/
+void MaskPostProcessor::dilateRowsHorizontal(const cv::Mat &src, cv::Mat &dst, int y0, int y1, int radius, std::vector<uint8_t> &padded)
+{
+	// Max over [x - radius, x + radius]; outside the image counts as 0 (cv::dilate's default border)
+	const int width = src.cols;
+	padded.assign(width + 2 * radius, 0);
+
+	for (int y = y0; y < y1; ++y)
+	{
+		const uint8_t *s = src.ptr<uint8_t>(y);
+		uint8_t *d = dst.ptr<uint8_t>(y);
+
+		std::copy(s, s + width, padded.begin() + radius);
+		std::copy(padded.begin(), padded.begin() + width, d);
+
+		for (int k = 1; k <= 2 * radius; ++k)
+			maxRow(d, padded.data() + k, width);
+	}
+}
+
+/*static*/
+void MaskPostProcessor::dilateRowsVertical(const cv::Mat &src, cv::Mat &dst, int y0, int y1, int radius)
+{
+	// Rows [y0, y1) of dst read rows [y0 - radius, y1 + radius) of src: the tile halo
+	const int width = src.cols;
+
+	for (int y = y0; y < y1; ++y)
+	{
+		const int first = std::max(0, y - radius);
+		const int last = std::min(src.rows - 1, y + radius);
+		uint8_t *d = dst.ptr<uint8_t>(y);
+
+		std::copy(src.ptr<uint8_t>(first), src.ptr<uint8_t>(first) + width, d);
+
+		for (int sy = first + 1; sy <= last; ++sy)
+			maxRow(d, src.ptr<uint8_t>(sy), width);
+	}
+}
+
+void MaskPostProcessor::processNetworkMask(cv::Mat &mask, const MaskPostParams &params, cv::Mat &history)
+{
+	if (temporalEnabled(params))
+		temporalPass(mask, history, params);
+
+	// Area filter and smoothing only apply to binary (thresholded) masks
+	if (params.enableThreshold)
+	{
+		if (params.contourFilter > 0.0f && params.contourFilter < 1.0f)
+			filterComponents(mask, params.contourFilter);
+
+		if (params.smoothContour > 0.0f)
+		{
+			const int k = smoothKernelSize(params.smoothContour);
+			cv::stackBlur(mask, mask, cv::Size(k, k));
+		}
+	}
+}
+
+void MaskPostProcessor::processFullResMask(const cv::Mat &mask, const MaskPostParams &params, const cv::Rect &roi, cv::Mat &dst, TilePool &pool)
+{
+	// Row tiles over the whole frame. Each tile fills its rows outside the ROI and upsamples the rows inside it.
+	const bool partial = roi != cv::Rect(0, 0, dst.cols, dst.rows);
+	cv::Mat target = dst(roi);
+
+	// If we smoothed, re-binarize as part of the upsample
+	const bool binarize = params.smoothContour > 0.0f;
+	const int workers = (int)pool.workers();
+	const int tiles = pool.tileCount(dst.rows);
+
+	prepareUpsample(mask.size(), roi.size());
+	rowBuffers.resize(2 * workers);
+
+	pool.run(tiles, [&](int tile, int worker) {
+		int y0, y1;
+		TilePool::tileRows(dst.rows, tiles, tile, y0, y1);
+
+		if (partial)
+			dst.rowRange(y0, y1).setTo(255);
+
+		const int roiY0 = std::max(y0, roi.y) - roi.y;
+		const int roiY1 = std::min(y1, roi.y + roi.height) - roi.y;
+
+		if (roiY0 < roiY1)
+			upsampleRows(mask, target, roiY0, roiY1, binarize, &rowBuffers[2 * worker]);
+	});
+
+	if (params.dilateIterations > 0)
+		dilate(dst, params.dilateIterations, pool);
+}
+
+void MaskPostProcessor::dilate(cv::Mat &dst, int radius, TilePool &pool)
+{
+	// Iterated 3x3 dilation == one square of radius iterations, separable: a horizontal pass over each tile's own
+	//	rows, then a vertical pass whose tiles read radius rows of halo on either side
+	const int tiles = pool.tileCount(dst.rows);
+	horizontalMax.create(dst.size(), CV_8UC1);
+	dilated.create(dst.size(), CV_8UC1);
+	paddedRows.resize(pool.workers());
+
+	pool.run(tiles, [&](int tile, int worker) {
+		int y0, y1;
+		TilePool::tileRows(dst.rows, tiles, tile, y0, y1);
+		dilateRowsHorizontal(dst, horizontalMax, y0, y1, radius, paddedRows[worker]);
+	});
+
+	pool.run(tiles, [&](int tile, int) {
+		int y0, y1;
+		TilePool::tileRows(dst.rows, tiles, tile, y0, y1);
+		dilateRowsVertical(horizontalMax, dilated, y0, y1, radius);
+	});
+
+	std::swap(dst, dilated);
+}
+
+/*static*/
+void MaskPostProcessor::runLegacyNetwork(const cv::Mat &output8U, const MaskPostParams &params, cv::Mat &history, cv::Mat &mask)
+{
+	const uint8_t level = thresholdLevel(params);
+
+	if (temporalEnabled(params))
+	{
+		cv::Mat soft;
+		cv::subtract(cv::Scalar(255), output8U, soft);
+		soft.convertTo(soft, CV_32F);
+
+		if (history.size() != soft.size() || history.type() != CV_32FC1)
+			soft.copyTo(history);
+
+		// weight = clamp(still + (1 - still) * (|soft - history| - STILL) / (MOTION - STILL), still, 1)
+		const double still = 1.0 - params.temporalSmoothFactor;
+		const double slope = (1.0 - still) / (MASK_TEMPORAL_MOTION_LEVEL - MASK_TEMPORAL_STILL_LEVEL);
+		cv::Mat weight;
+		cv::absdiff(soft, history, weight);
+		weight.convertTo(weight, CV_32F, slope, still - slope * MASK_TEMPORAL_STILL_LEVEL);
+		cv::max(weight, still, weight);
+		cv::min(weight, 1.0, weight);
+
+		history += (soft - history).mul(weight);
+		history.convertTo(mask, CV_8U);
+
+		if (params.enableThreshold)
+			cv::compare(mask, cv::Scalar(255 - level), mask, cv::CMP_GT);
+	}
+	else
+	{
+		if (params.enableThreshold)
+			cv::compare(output8U, cv::Scalar(level), mask, cv::CMP_LT);
+		else
+			cv::subtract(cv::Scalar(255), output8U, mask);
+	}
+
+	if (params.enableThreshold)
+	{
+		if (params.contourFilter > 0.0f && params.contourFilter < 1.0f)
+		{
+			std::vector<std::vector<cv::Point>> contours;
+			cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+			const double contourSizeThreshold = (double)mask.total() * params.contourFilter;
+			mask.setTo(0);
+			for (int i = 0; i < (int)contours.size(); ++i)
+				if (cv::contourArea(contours[i]) > contourSizeThreshold)
+					cv::drawContours(mask, contours, i, cv::Scalar(255), -1);
+		}
+
+		if (params.smoothContour > 0.0f)
+		{
+			const int k = smoothKernelSize(params.smoothContour);
+			cv::stackBlur(mask, mask, cv::Size(k, k));
+		}
+	}
+}
+
+/*static*/
+void MaskPostProcessor::runLegacyFullRes(const cv::Mat &mask, const MaskPostParams &params, const cv::Rect &roi, cv::Mat &dst)
+{
+	if (roi == cv::Rect(0, 0, dst.cols, dst.rows))
+	{
+		cv::resize(mask, dst, dst.size());
+	}
+	else
+	{
+		dst.setTo(255);
+		cv::Mat roiMask = dst(roi);
+		cv::resize(mask, roiMask, roi.size());
+	}
+
+	if (params.smoothContour > 0.0f)
+		cv::threshold(dst, dst, 128, 255, cv::THRESH_BINARY);
+
+	if (params.dilateIterations > 0)
+	{
+		cv::Mat dilated;
+		cv::dilate(dst, dilated, cv::Mat(), cv::Point(-1, -1), params.dilateIterations);
+		dilated.copyTo(dst);
+	}
+}
+
+/*static*/
+MaskVerifyResult MaskPostProcessor::compare(const cv::Mat &a, const cv::Mat &b)
+{
+	MaskVerifyResult result;
+
+	if (a.size() != b.size() || a.type() != b.type())
+	{
+		result.pixels = a.total();
+		result.mismatchedPixels = a.total();
+		result.maxDifference = 255;
+		return result;
+	}
+
+	cv::Mat diff;
+	cv::absdiff(a, b, diff);
+
+	double maxDifference = 0.0;
+	cv::minMaxLoc(diff, nullptr, &maxDifference);
+
+	result.pixels = a.total();
+	result.mismatchedPixels = (uint64_t)cv::countNonZero(diff > MASK_VERIFY_LEVEL_TOLERANCE);
+	result.maxDifference = (int)maxDifference;
+	return result;
+}
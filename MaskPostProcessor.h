@@ -0,0 +1,109 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "TilePool.h"
+
+#include <cstdint>
+#include <vector>
+
+// Per-pixel temporal smoothing: pixels that changed by up to MASK_TEMPORAL_STILL_LEVEL (8-bit levels, sensor and
+//	model noise) get the full smoothing, pixels that changed by MASK_TEMPORAL_MOTION_LEVEL or more take the new value
+#define MASK_TEMPORAL_STILL_LEVEL 8
+#define MASK_TEMPORAL_MOTION_LEVEL 48
+
+// Verify mode: a stage output differing from the legacy path by more than MASK_VERIFY_LEVEL_TOLERANCE levels on more
+//	than MASK_VERIFY_PIXEL_TOLERANCE of its pixels is reported
+#define MASK_VERIFY_LEVEL_TOLERANCE 1
+#define MASK_VERIFY_PIXEL_TOLERANCE 0.001
+
+struct MaskPostParams
+{
+	bool enableThreshold = true;
+	float threshold = 0.5f;
+	float temporalSmoothFactor = 0.0f; // share of the history kept on still pixels, 0 = off
+	float contourFilter = 0.0f;
+	float smoothContour = 0.0f;
+	int dilateIterations = 0; // feather, as iterations of a 3x3 dilation
+};
+
+struct MaskVerifyResult
+{
+	uint64_t pixels = 0;
+	uint64_t mismatchedPixels = 0; // off by more than MASK_VERIFY_LEVEL_TOLERANCE
+	int maxDifference = 0;
+};
+
+/**
+ * 8-bit fixed-point mask post-processing
+ * Replaces the chain of whole-image OpenCV passes after inference with:
+ *  - one pass from the float network output to the 8-bit mask (convert, threshold / invert)
+ *  - with temporal smoothing, that pass only converts, and one more pass runs a per-pixel EMA on the soft mask whose
+ *    weight follows how much each pixel changed, then thresholds; the history is kept in 8.8 fixed point
+ *  - a labeled-components area filter in place of findContours / contourArea / drawContours
+ *  - one fused bilinear upsample + re-binarize pass to full resolution, and the feather dilation as a single
+ *    separable rectangular max; both run in row tiles on a TilePool
+ * The per-pixel loops have AVX2 / NEON row kernels (dispatched as in Preprocess.h) with the scalar code finishing each row.
+ * The legacy OpenCV chain is kept as runLegacyNetwork() / runLegacyFullRes() so verify mode can compare both on the same network output.
+ */
+class MaskPostProcessor
+{
+public:
+	static bool temporalEnabled(const MaskPostParams &params) { return params.temporalSmoothFactor > 0.0f && params.temporalSmoothFactor < 1.0f; }
+
+	// outputF32 is the post-processed network output (single channel float, letterbox padding already cropped).
+	//	Thresholds it, or with temporal smoothing enabled leaves the soft (inverted) mask for temporalPass to threshold.
+	static void thresholdPass(const cv::Mat &outputF32, const MaskPostParams &params, cv::Mat &mask);
+
+	// Per-pixel adaptive EMA of the soft mask against the history (CV_16UC1, 8.8 fixed point), then threshold
+	static void temporalPass(cv::Mat &mask, cv::Mat &history, const MaskPostParams &params);
+
+	// Moves a history covering historyRoi (frame pixels) onto the pixel grid of a mask covering roi, so the EMA keeps
+	//	blending each frame point with its own past. Pixels the old crop didn't cover start from the (soft) mask.
+	//	Takes both the 8.8 fixed-point history and the legacy float one.
+	void remapHistory(cv::Mat &history, const cv::Rect &historyRoi, const cv::Mat &mask, const cv::Rect &roi);
+
+	// Keeps the (hole-filled) foreground shapes whose area exceeds minAreaFraction of the mask, like filled external contours
+	void filterComponents(cv::Mat &mask, double minAreaFraction);
+
+	// Network-resolution stages after thresholdPass (temporal, area filter, smoothing)
+	void processNetworkMask(cv::Mat &mask, const MaskPostParams &params, cv::Mat &history);
+
+	// Full-resolution stages into dst (already sized to the frame): upsample into roi, re-binarize, feather.
+	//	Outside roi is background. dst may be swapped with an internal buffer. Runs in row tiles on pool.
+	void processFullResMask(const cv::Mat &mask, const MaskPostParams &params, const cv::Rect &roi, cv::Mat &dst, TilePool &pool);
+
+	// Feather dilation (square of the given radius) of a full-resolution mask; dst may be swapped with an internal buffer
+	void dilate(cv::Mat &dst, int radius, TilePool &pool);
+
+	// Reference chain on the 8-bit network output in plain OpenCV calls (float history); same stage split as above
+	static void runLegacyNetwork(const cv::Mat &output8U, const MaskPostParams &params, cv::Mat &history, cv::Mat &mask);
+	static void runLegacyFullRes(const cv::Mat &mask, const MaskPostParams &params, const cv::Rect &roi, cv::Mat &dst);
+
+	static MaskVerifyResult compare(const cv::Mat &a, const cv::Mat &b);
+
+private:
+	// Bilinear upsample column table for a src -> dst size pair, shared by every tile
+	void prepareUpsample(const cv::Size &srcSize, const cv::Size &dstSize);
+
+	// Bilinear upsample of rows [y0, y1) of dst (optionally binarized at > 128); rows is a pair of per-worker row buffers
+	void upsampleRows(const cv::Mat &src, cv::Mat &dst, int y0, int y1, bool binarize, std::vector<uint16_t> *rows);
+
+	// Rectangular dilation by radius, split into a horizontal and a vertical max pass over rows [y0, y1)
+	static void dilateRowsHorizontal(const cv::Mat &src, cv::Mat &dst, int y0, int y1, int radius, std::vector<uint8_t> &padded);
+	static void dilateRowsVertical(const cv::Mat &src, cv::Mat &dst, int y0, int y1, int radius);
+
+	cv::Mat remappedHistory;
+	cv::Mat background;
+	cv::Mat filled;
+	cv::Mat labels;
+	cv::Mat stats;
+	cv::Mat centroids;
+	std::vector<uint8_t> lut;
+	std::vector<int> xOffsets;
+	std::vector<uint16_t> xWeights;
+	std::vector<std::vector<uint16_t>> rowBuffers; // two per worker
+	std::vector<std::vector<uint8_t>> paddedRows;  // one per worker
+	cv::Mat horizontalMax;
+	cv::Mat dilated;
+};
@@ -0,0 +1,127 @@
+#include "MaskPropagator.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+static int blockSAD(const cv::Mat &a, int ax, int ay, const cv::Mat &b, int bx, int by)
+{
+	int sad = 0;
+
+	for (int y = 0; y < PROPAGATION_BLOCK_SIZE; ++y)
+	{
+		const uint8_t *rowA = a.ptr<uint8_t>(ay + y) + ax;
+		const uint8_t *rowB = b.ptr<uint8_t>(by + y) + bx;
+
+		for (int x = 0; x < PROPAGATION_BLOCK_SIZE; ++x)
+			sad += std::abs((int)rowA[x] - (int)rowB[x]);
+	}
+
+	return sad;
+}
+
+// Offset of the minimum of a parabola through three costs, in (-0.5, 0.5)
+static float subpixelOffset(int left, int center, int right)
+{
+	const int denominator = left - 2 * center + right;
+
+	if (denominator <= 0)
+		return 0.0f;
+
+	return std::clamp(0.5f * (float)(left - right) / (float)denominator, -0.5f, 0.5f);
+}
+
+bool MaskPropagator::estimate(const cv::Mat &previousThumb, const cv::Mat &thumb)
+{
+	if (previousThumb.empty() || previousThumb.size() != thumb.size() || thumb.type() != CV_8UC1)
+		return false;
+
+	const int blocksX = thumb.cols / PROPAGATION_BLOCK_SIZE;
+	const int blocksY = thumb.rows / PROPAGATION_BLOCK_SIZE;
+	const int searchSize = 2 * PROPAGATION_SEARCH_RADIUS + 1;
+
+	blockFlow.create(blocksY, blocksX, CV_32FC2);
+
+	bool moved = false;
+	int costs[searchSize][searchSize];
+
+	for (int by = 0; by < blocksY; ++by)
+	{
+		cv::Vec2f *flowRow = blockFlow.ptr<cv::Vec2f>(by);
+
+		for (int bx = 0; bx < blocksX; ++bx)
+		{
+			const int x0 = bx * PROPAGATION_BLOCK_SIZE;
+			const int y0 = by * PROPAGATION_BLOCK_SIZE;
+
+			int bestX = 0, bestY = 0;
+			int bestCost = INT_MAX;
+
+			for (int dy = -PROPAGATION_SEARCH_RADIUS; dy <= PROPAGATION_SEARCH_RADIUS; ++dy)
+			{
+				for (int dx = -PROPAGATION_SEARCH_RADIUS; dx <= PROPAGATION_SEARCH_RADIUS; ++dx)
+				{
+					int &cost = costs[dy + PROPAGATION_SEARCH_RADIUS][dx + PROPAGATION_SEARCH_RADIUS];
+
+					if (x0 + dx < 0 || y0 + dy < 0 || x0 + dx + PROPAGATION_BLOCK_SIZE > thumb.cols || y0 + dy + PROPAGATION_BLOCK_SIZE > thumb.rows)
+					{
+						cost = INT_MAX;
+						continue;
+					}
+
+					cost = blockSAD(thumb, x0, y0, previousThumb, x0 + dx, y0 + dy) + PROPAGATION_MOTION_PENALTY * (std::abs(dx) + std::abs(dy));
+
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestX = dx;
+						bestY = dy;
+					}
+				}
+			}
+
+			float fx = (float)bestX, fy = (float)bestY;
+			const int cx = bestX + PROPAGATION_SEARCH_RADIUS, cy = bestY + PROPAGATION_SEARCH_RADIUS;
+
+			if (cx > 0 && cx < searchSize - 1 && costs[cy][cx - 1] != INT_MAX && costs[cy][cx + 1] != INT_MAX)
+				fx += subpixelOffset(costs[cy][cx - 1], bestCost, costs[cy][cx + 1]);
+
+			if (cy > 0 && cy < searchSize - 1 && costs[cy - 1][cx] != INT_MAX && costs[cy + 1][cx] != INT_MAX)
+				fy += subpixelOffset(costs[cy - 1][cx], bestCost, costs[cy + 1][cx]);
+
+			flowRow[bx] = cv::Vec2f(fx, fy);
+			moved |= bestX != 0 || bestY != 0;
+		}
+	}
+
+	return moved;
+}
+
+void MaskPropagator::warp(const cv::Mat &src, cv::Mat &dst)
+{
+	// Block flow is in thumbnail pixels; scale it to mask pixels while it is still tiny
+	const double scaleX = (double)src.cols / (double)(blockFlow.cols * PROPAGATION_BLOCK_SIZE);
+	const double scaleY = (double)src.rows / (double)(blockFlow.rows * PROPAGATION_BLOCK_SIZE);
+	cv::multiply(blockFlow, cv::Scalar(scaleX, scaleY), scaledFlow);
+	cv::resize(scaledFlow, pixelFlow, src.size(), 0, 0, cv::INTER_LINEAR);
+
+	if (grid.size() != src.size())
+	{
+		grid.create(src.size(), CV_32FC2);
+
+		for (int y = 0; y < grid.rows; ++y)
+		{
+			cv::Vec2f *row = grid.ptr<cv::Vec2f>(y);
+
+			for (int x = 0; x < grid.cols; ++x)
+				row[x] = cv::Vec2f((float)x, (float)y);
+		}
+	}
+
+	// Nearest sampling only moves mask values around: the result is warped again on the next skipped frame, and
+	//	bilinear sampling would soften and erode the edges a little more on every step of the run
+	cv::add(grid, pixelFlow, map);
+	cv::remap(src, dst, map, cv::noArray(), cv::INTER_NEAREST, cv::BORDER_REPLICATE);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+// Block matching on the change detector thumbnail: block size and search radius in thumbnail pixels, and the SAD
+//	penalty per pixel of displacement that keeps flat, textureless blocks at zero motion
+#define PROPAGATION_BLOCK_SIZE 8
+#define PROPAGATION_SEARCH_RADIUS 4
+#define PROPAGATION_MOTION_PENALTY 16
+
+// Frame-to-frame motion (see ChangeDetector::motion) below which the previous mask is kept as is
+#define PROPAGATION_MIN_MOTION 0.25
+
+/**
+ * Mask propagation between inference frames
+ * Estimates coarse motion between two consecutive luma thumbnails with block matching (sub-pixel refined), and warps
+ * the last mask along it, so skipped frames get a mask that follows the subject instead of lagging at the last
+ * inference. Both thumbnails and the mask must cover the same content area.
+ */
+class MaskPropagator
+{
+public:
+	// Block motion from previous to current; returns false when nothing moved enough to be worth a warp
+	bool estimate(const cv::Mat &previousThumb, const cv::Mat &thumb);
+
+	// dst(p) = src(p + motion(p)), with the block motion bilinearly upsampled to the mask resolution and the mask
+	//	sampled nearest, so repeated warps over a run of skipped frames don't erode it
+	void warp(const cv::Mat &src, cv::Mat &dst);
+
+private:
+	cv::Mat blockFlow; // CV_32FC2, per block of the current thumbnail: offset to where it was in the previous one
+	cv::Mat scaledFlow;
+	cv::Mat pixelFlow;
+	cv::Mat grid; // identity map at the mask resolution
+	cv::Mat map;
+};
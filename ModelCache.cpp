@@ -0,0 +1,142 @@
+#include "ModelCache.h"
+
+#include <obs-module.h>
+#include <onnxruntime_cxx_api.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+#define MODEL_CACHE_DIR "ort-cache"
+#define MODEL_CACHE_EXTENSION ".ort"
+
+// FNV-1a, 64 bit
+#define MODEL_CACHE_FNV_OFFSET 14695981039346656037ULL
+#define MODEL_CACHE_FNV_PRIME 1099511628211ULL
+
+/*static*/
+uint64_t ModelCache::hashBytes(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * MODEL_CACHE_FNV_PRIME;
+
+	return hash;
+}
+
+/*static*/
+bool ModelCache::hashFile(const std::filesystem::path &path, uint64_t &hash)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file)
+		return false;
+
+	std::vector<char> chunk(MODEL_CACHE_READ_CHUNK);
+
+	while (file)
+	{
+		file.read(chunk.data(), (std::streamsize)chunk.size());
+		hash = hashBytes(hash, chunk.data(), (size_t)file.gcount());
+	}
+
+	return file.eof();
+}
+
+/*static*/
+std::filesystem::path ModelCache::entryPath(const std::filesystem::path &modelPath, const std::string &optionsKey)
+{
+	uint64_t hash = MODEL_CACHE_FNV_OFFSET;
+
+	if (!hashFile(modelPath, hash))
+		return {};
+
+	const char *ortVersion = OrtGetApiBase()->GetVersionString();
+	hash = hashBytes(hash, ortVersion, std::strlen(ortVersion));
+
+	// Options get their own name part, so replacing a stale entry leaves entries for other providers alone
+	const uint64_t optionsHash = hashBytes(MODEL_CACHE_FNV_OFFSET, optionsKey.data(), optionsKey.size());
+
+	char *configPath = obs_module_config_path(MODEL_CACHE_DIR);
+
+	if (!configPath)
+		return {};
+
+	const std::filesystem::path dir = std::filesystem::u8path(configPath);
+	bfree(configPath);
+
+	std::error_code error;
+	std::filesystem::create_directories(dir, error);
+
+	if (error)
+		return {};
+
+	char name[48];
+	snprintf(name, sizeof(name), "-%016llx-%016llx", (unsigned long long)optionsHash, (unsigned long long)hash);
+	return dir / (modelPath.stem().string() + name + MODEL_CACHE_EXTENSION);
+}
+
+/*static*/
+bool ModelCache::isValid(const std::filesystem::path &entry)
+{
+	// ORT format models are flatbuffers: a 4 byte root offset, then the "ORTM" file identifier
+	std::ifstream file(entry, std::ios::binary);
+	char header[8] = {};
+
+	if (!file || !file.read(header, sizeof(header)))
+		return false;
+
+	return std::memcmp(header + 4, "ORTM", 4) == 0;
+}
+
+/*static*/
+std::filesystem::path ModelCache::pendingPath(const std::filesystem::path &entry)
+{
+	std::filesystem::path pending = entry;
+	pending += ".tmp";
+	return pending;
+}
+
+/*static*/
+bool ModelCache::commit(const std::filesystem::path &written, const std::filesystem::path &entry)
+{
+	std::error_code error;
+
+	if (!isValid(written))
+	{
+		std::filesystem::remove(written, error);
+		return false;
+	}
+
+	// Written under a temporary name so a crash mid-save never leaves a truncated entry behind
+	std::filesystem::rename(written, entry, error);
+
+	if (error)
+	{
+		std::filesystem::remove(written, error);
+		return false;
+	}
+
+	// Older entries with the same model and options were keyed by a previous model file or runtime and will never hit again
+	const std::string prefix = entry.stem().string().substr(0, entry.stem().string().rfind('-') + 1);
+
+	for (const auto &file : std::filesystem::directory_iterator(entry.parent_path(), error))
+	{
+		const std::string name = file.path().filename().string();
+
+		if (file.path() != entry && name.compare(0, prefix.size(), prefix) == 0 && file.path().extension() == MODEL_CACHE_EXTENSION)
+			invalidate(file.path());
+	}
+
+	return true;
+}
+
+/*static*/
+void ModelCache::invalidate(const std::filesystem::path &entry)
+{
+	std::error_code error;
+	std::filesystem::remove(entry, error);
+}
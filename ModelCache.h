@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Bytes hashed per read when keying a model file
+#define MODEL_CACHE_READ_CHUNK (1 << 20)
+
+/**
+ * On-disk cache of optimized models
+ * Graph optimization at ORT_ENABLE_ALL is most of a cold session start. The first session built from a model saves its
+ * optimized graph in ORT format (SetOptimizedModelFilePath) under the module config dir, and later starts load that
+ * instead. Entries are named after the model and a hash of its bytes, the ORT version and the session options key
+ * (execution provider, threads), so a changed model or runtime simply misses; an entry that fails validation or loading
+ * is deleted, and writing a new entry removes the older ones of the same model and options.
+ */
+class ModelCache
+{
+public:
+	// Entry path for the model and options, or empty when the model can't be read or the cache dir is unavailable
+	static std::filesystem::path entryPath(const std::filesystem::path &modelPath, const std::string &optionsKey);
+
+	// Present, non-empty and carrying the ORT format file identifier
+	static bool isValid(const std::filesystem::path &entry);
+
+	// Moves a freshly written entry into place and drops older entries of the same model and options
+	static bool commit(const std::filesystem::path &written, const std::filesystem::path &entry);
+
+	static void invalidate(const std::filesystem::path &entry);
+
+	// Where a session being built writes the entry before commit
+	static std::filesystem::path pendingPath(const std::filesystem::path &entry);
+
+private:
+	static bool hashFile(const std::filesystem::path &path, uint64_t &hash);
+	static uint64_t hashBytes(uint64_t hash, const void *data, size_t size);
+};
@@ -4,8 +4,12 @@
 #include <opencv2/imgproc.hpp>
 #include <algorithm>
 #include <memory>
+#include <mutex>
 #include <vector>
 
+#include "Preprocess.h"
+#include "ScratchArena.h"
+
 template<typename T> static inline T vectorProduct(const std::vector<T> &v)
 {
 	T product = 1;
@@ -17,15 +21,6 @@ template<typename T> static inline T vectorProduct(const std::vector<T> &v)
 	return product;
 }
 
-static inline void hwc_to_chw(cv::InputArray src, cv::OutputArray dst)
-{
-	std::vector<cv::Mat> channels;
-	cv::split(src, channels);
-	for (auto &img : channels)
-		img = img.reshape(1, 1); // flatten each C plane
-	cv::hconcat(channels, dst);
-}
-
 static inline void chw_to_hwc_32f(cv::InputArray src, cv::OutputArray dst)
 {
 	const cv::Mat srcMat = src.getMat();
@@ -38,12 +33,15 @@ static inline void chw_to_hwc_32f(cv::InputArray src, cv::OutputArray dst)
 	const int channelStride = height * width;
 	cv::Mat flat = srcMat.reshape(1, 1);
 
-	std::vector<cv::Mat> chs(channels);
+	// Plane headers only; merge() writes into dst without reallocating when it is already sized
+	constexpr int maxChannels = 4;
+	CV_Assert(channels <= maxChannels);
+	cv::Mat chs[maxChannels];
 	for (int i = 0; i < channels; ++i)
 	{
 		chs[i] = cv::Mat(height, width, CV_MAKE_TYPE(CV_32F, 1), flat.ptr<float>(0) + i * channelStride);
 	}
-	cv::merge(chs, dst);
+	cv::merge(chs, (size_t)channels, dst);
 }
 
 class Model
@@ -52,7 +50,7 @@ public:
 	virtual ~Model() = default;
 
 	// Names / shapes
-	virtual void populateInputOutputNames(const std::unique_ptr<Ort::Session> &session, std::vector<Ort::AllocatedStringPtr> &inputNames, std::vector<Ort::AllocatedStringPtr> &outputNames)
+	virtual void populateInputOutputNames(const std::shared_ptr<Ort::Session> &session, std::vector<Ort::AllocatedStringPtr> &inputNames, std::vector<Ort::AllocatedStringPtr> &outputNames)
 	{
 		Ort::AllocatorWithDefaultOptions allocator;
 		inputNames.clear();
@@ -61,7 +59,7 @@ public:
 		outputNames.push_back(session->GetOutputNameAllocated(0, allocator));
 	}
 
-	virtual bool populateInputOutputShapes(const std::unique_ptr<Ort::Session> &session, std::vector<std::vector<int64_t>> &inputDims, std::vector<std::vector<int64_t>> &outputDims)
+	virtual bool populateInputOutputShapes(const std::shared_ptr<Ort::Session> &session, std::vector<std::vector<int64_t>> &inputDims, std::vector<std::vector<int64_t>> &outputDims)
 	{
 		inputDims.clear();
 		outputDims.clear();
@@ -121,11 +119,15 @@ public:
 		inputHeight = (uint32_t)inputDims[0][1];
 	}
 
-	virtual void prepareInputToNetwork(cv::Mat &resizedImage, cv::Mat &preprocessedImage) { preprocessedImage = resizedImage / 255.f; }
-
-	virtual void postprocessOutput(cv::Mat &output) { (void)output; }
+	// imageBGRA is BGRA8 at network input size, written straight into the input tensor
+	virtual void preprocessInput(const cv::Mat &imageBGRA, std::vector<std::vector<float>> &inputTensorValues) { fusedPreprocessBGRA<TensorLayout::BHWC, NormUnit>(imageBGRA.data, imageBGRA.step, imageBGRA.cols, imageBGRA.rows, inputTensorValues[0].data()); }
 
-	virtual void loadInputToTensor(const cv::Mat &preprocessedImage, uint32_t inputWidth, uint32_t inputHeight, std::vector<std::vector<float>> &inputTensorValues) { preprocessedImage.copyTo(cv::Mat(inputHeight, inputWidth, CV_32FC3, &(inputTensorValues[0][0]))); }
+	// Buffers needed beyond the tensor memory come from the filter's scratch arena
+	virtual void postprocessOutput(cv::Mat &output, ScratchArena &scratch)
+	{
+		(void)output;
+		(void)scratch;
+	}
 
 	virtual cv::Mat getNetworkOutput(const std::vector<std::vector<int64_t>> &outputDims, std::vector<std::vector<float>> &outputTensorValues)
 	{
@@ -139,7 +141,7 @@ public:
 	virtual void assignOutputToInput(std::vector<std::vector<float>> &, std::vector<std::vector<float>> &) {}
 
 	// Inference
-	virtual void runNetworkInference(const std::unique_ptr<Ort::Session> &session, const std::vector<Ort::AllocatedStringPtr> &inputNames, const std::vector<Ort::AllocatedStringPtr> &outputNames, const std::vector<Ort::Value> &inputTensor, std::vector<Ort::Value> &outputTensor)
+	virtual void runNetworkInference(const std::shared_ptr<Ort::Session> &session, const std::vector<Ort::AllocatedStringPtr> &inputNames, const std::vector<Ort::AllocatedStringPtr> &outputNames, const std::vector<Ort::Value> &inputTensor, std::vector<Ort::Value> &outputTensor)
 	{
 		if (inputNames.empty() || outputNames.empty() || inputTensor.empty() || outputTensor.empty())
 			return;
@@ -160,17 +162,17 @@ public:
 class ModelBCHW : public Model
 {
 public:
-	void prepareInputToNetwork(cv::Mat &resizedImage, cv::Mat &preprocessedImage) override
-	{
-		resizedImage = resizedImage / 255.f;
-		hwc_to_chw(resizedImage, preprocessedImage);
-	}
+	void preprocessInput(const cv::Mat &imageBGRA, std::vector<std::vector<float>> &inputTensorValues) override { fusedPreprocessBGRA<TensorLayout::BCHW, NormUnit>(imageBGRA.data, imageBGRA.step, imageBGRA.cols, imageBGRA.rows, inputTensorValues[0].data()); }
 
-	void postprocessOutput(cv::Mat &output) override
+	void postprocessOutput(cv::Mat &output, ScratchArena &scratch) override
 	{
-		cv::Mat hwc;
+		// A single plane is already HWC
+		if (output.channels() == 1)
+			return;
+
+		cv::Mat &hwc = scratch.get(SCRATCH_MODEL_OUTPUT, output.size(), output.type());
 		chw_to_hwc_32f(output, hwc);
-		hwc.copyTo(output);
+		output = hwc;
 	}
 
 	void getNetworkInputSize(const std::vector<std::vector<int64_t>> &inputDims, uint32_t &inputWidth, uint32_t &inputHeight) override
@@ -188,8 +190,6 @@ public:
 		const int Ctype = CV_MAKE_TYPE(CV_32F, (int)outputDims[0].at(1));
 		return cv::Mat(H, W, Ctype, outputTensorValues[0].data());
 	}
-
-	void loadInputToTensor(const cv::Mat &preprocessedImage, uint32_t, uint32_t, std::vector<std::vector<float>> &inputTensorValues) override { inputTensorValues[0].assign(preprocessedImage.begin<float>(), preprocessedImage.end<float>()); }
 };
 
 // MediaPipe (BHWC 2-channel output, keep 2nd channel)
@@ -202,11 +202,11 @@ public:
 		const uint32_t H = (uint32_t)outputDims[0].at(1);
 		return cv::Mat(H, W, CV_32FC2, outputTensorValues[0].data());
 	}
-	void postprocessOutput(cv::Mat &outputImage) override
+	void postprocessOutput(cv::Mat &outputImage, ScratchArena &scratch) override
 	{
-		std::vector<cv::Mat> splitv;
-		cv::split(outputImage, splitv);
-		outputImage = splitv[1]; // keep channel 1
+		cv::Mat &channel = scratch.get(SCRATCH_MODEL_CHANNEL, outputImage.size(), CV_32FC1);
+		cv::extractChannel(outputImage, channel, 1); // keep channel 1
+		outputImage = channel;
 	}
 };
 
@@ -214,22 +214,26 @@ public:
 class ModelPPHumanSeg : public ModelBCHW
 {
 public:
-	void prepareInputToNetwork(cv::Mat &resizedImage, cv::Mat &preprocessedImage) override
+	// (x / 256 - 0.5) / 0.5
+	struct Norm
 	{
-		resizedImage = (resizedImage / 256.0 - cv::Scalar(0.5, 0.5, 0.5)) / cv::Scalar(0.5, 0.5, 0.5);
-		hwc_to_chw(resizedImage, preprocessedImage);
-	}
+		static constexpr float scale[3] = {1.0f / 128.0f, 1.0f / 128.0f, 1.0f / 128.0f};
+		static constexpr float bias[3] = {-1.0f, -1.0f, -1.0f};
+	};
+
+	void preprocessInput(const cv::Mat &imageBGRA, std::vector<std::vector<float>> &inputTensorValues) override { fusedPreprocessBGRA<TensorLayout::BCHW, Norm>(imageBGRA.data, imageBGRA.step, imageBGRA.cols, imageBGRA.rows, inputTensorValues[0].data()); }
 	cv::Mat getNetworkOutput(const std::vector<std::vector<int64_t>> &outputDims, std::vector<std::vector<float>> &outputTensorValues) override
 	{
 		const uint32_t W = (uint32_t)outputDims[0].at(2);
 		const uint32_t H = (uint32_t)outputDims[0].at(1);
 		return cv::Mat(H, W, CV_32FC2, outputTensorValues[0].data());
 	}
-	void postprocessOutput(cv::Mat &outputImage) override
+	void postprocessOutput(cv::Mat &outputImage, ScratchArena &scratch) override
 	{
-		std::vector<cv::Mat> splitv;
-		cv::split(outputImage, splitv);
-		cv::normalize(splitv[1], outputImage, 1.0, 0.0, cv::NORM_MINMAX);
+		cv::Mat &channel = scratch.get(SCRATCH_MODEL_CHANNEL, outputImage.size(), CV_32FC1);
+		cv::extractChannel(outputImage, channel, 1);
+		cv::normalize(channel, channel, 1.0, 0.0, cv::NORM_MINMAX);
+		outputImage = channel;
 	}
 };
 
@@ -237,7 +241,7 @@ public:
 class ModelRMBG : public ModelBCHW
 {
 public:
-	bool populateInputOutputShapes(const std::unique_ptr<Ort::Session> &session, std::vector<std::vector<int64_t>> &inputDims, std::vector<std::vector<int64_t>> &outputDims) override
+	bool populateInputOutputShapes(const std::shared_ptr<Ort::Session> &session, std::vector<std::vector<int64_t>> &inputDims, std::vector<std::vector<int64_t>> &outputDims) override
 	{
 		ModelBCHW::populateInputOutputShapes(session, inputDims, outputDims);
 		// output NCHW: match input H/W
@@ -251,7 +255,7 @@ public:
 class ModelRVM : public ModelBCHW
 {
 public:
-	void populateInputOutputNames(const std::unique_ptr<Ort::Session> &session, std::vector<Ort::AllocatedStringPtr> &inputNames, std::vector<Ort::AllocatedStringPtr> &outputNames) override
+	void populateInputOutputNames(const std::shared_ptr<Ort::Session> &session, std::vector<Ort::AllocatedStringPtr> &inputNames, std::vector<Ort::AllocatedStringPtr> &outputNames) override
 	{
 		Ort::AllocatorWithDefaultOptions allocator;
 		inputNames.clear();
@@ -262,7 +266,7 @@ public:
 			outputNames.push_back(session->GetOutputNameAllocated(i, allocator));
 	}
 
-	bool populateInputOutputShapes(const std::unique_ptr<Ort::Session> &session, std::vector<std::vector<int64_t>> &inputDims, std::vector<std::vector<int64_t>> &outputDims) override
+	bool populateInputOutputShapes(const std::shared_ptr<Ort::Session> &session, std::vector<std::vector<int64_t>> &inputDims, std::vector<std::vector<int64_t>> &outputDims) override
 	{
 		inputDims.clear();
 		outputDims.clear();
@@ -305,9 +309,9 @@ public:
 		return true;
 	}
 
-	void loadInputToTensor(const cv::Mat &preprocessedImage, uint32_t, uint32_t, std::vector<std::vector<float>> &inputTensorValues) override
+	void preprocessInput(const cv::Mat &imageBGRA, std::vector<std::vector<float>> &inputTensorValues) override
 	{
-		inputTensorValues[0].assign(preprocessedImage.begin<float>(), preprocessedImage.end<float>());
+		ModelBCHW::preprocessInput(imageBGRA, inputTensorValues);
 		inputTensorValues[5][0] = 1.0f; // downsample ratio
 	}
 
@@ -323,26 +327,26 @@ public:
 class ModelSelfie : public Model
 {
 public:
-	void postprocessOutput(cv::Mat &outputImage) override { cv::normalize(outputImage, outputImage, 1.0, 0.0, cv::NORM_MINMAX); }
+	void postprocessOutput(cv::Mat &outputImage, ScratchArena &) override { cv::normalize(outputImage, outputImage, 1.0, 0.0, cv::NORM_MINMAX); }
 };
 
 // SINET (BCHW, custom mean/std, output 2ch where we keep ch-1)
 class ModelSINET : public ModelBCHW
 {
 public:
-	void prepareInputToNetwork(cv::Mat &resizedImage, cv::Mat &preprocessedImage) override
+	// (x - mean) / (std * 255)
+	struct Norm
 	{
-		resizedImage = (resizedImage - cv::Scalar(102.890434, 111.25247, 126.91212)) / cv::Scalar(62.93292 * 255.0, 62.82138 * 255.0, 66.355705 * 255.0);
-		hwc_to_chw(resizedImage, preprocessedImage);
-	}
+		static constexpr float scale[3] = {(float)(1.0 / (62.93292 * 255.0)), (float)(1.0 / (62.82138 * 255.0)), (float)(1.0 / (66.355705 * 255.0))};
+		static constexpr float bias[3] = {(float)(-102.890434 / (62.93292 * 255.0)), (float)(-111.25247 / (62.82138 * 255.0)), (float)(-126.91212 / (66.355705 * 255.0))};
+	};
+
+	void preprocessInput(const cv::Mat &imageBGRA, std::vector<std::vector<float>> &inputTensorValues) override { fusedPreprocessBGRA<TensorLayout::BCHW, Norm>(imageBGRA.data, imageBGRA.step, imageBGRA.cols, imageBGRA.rows, inputTensorValues[0].data()); }
 	cv::Mat getNetworkOutput(const std::vector<std::vector<int64_t>> &, std::vector<std::vector<float>> &outputTensorValues) override { return cv::Mat(320, 320, CV_32FC2, outputTensorValues[0].data()); }
-	void postprocessOutput(cv::Mat &outputImage) override
+	void postprocessOutput(cv::Mat &outputImage, ScratchArena &) override
 	{
-		cv::Mat hwc;
-		chw_to_hwc_32f(outputImage, hwc);
-		std::vector<cv::Mat> splitv;
-		cv::split(hwc, splitv);
-		outputImage = splitv[1];
+		// Output is planar, so channel 1 is simply the second plane of the tensor
+		outputImage = cv::Mat(outputImage.rows, outputImage.cols, CV_32FC1, outputImage.ptr<float>() + outputImage.total());
 	}
 };
 
@@ -350,18 +354,16 @@ public:
 class ModelTCMonoDepth : public ModelBCHW
 {
 public:
-	void prepareInputToNetwork(cv::Mat &resizedImage, cv::Mat &preprocessedImage) override
-	{
-		// keep 0..255
-		hwc_to_chw(resizedImage, preprocessedImage);
-	}
-	void postprocessOutput(cv::Mat &outputImage) override { cv::normalize(outputImage, outputImage, 1.0, 0.0, cv::NORM_MINMAX); }
+	// keep 0..255
+	void preprocessInput(const cv::Mat &imageBGRA, std::vector<std::vector<float>> &inputTensorValues) override { fusedPreprocessBGRA<TensorLayout::BCHW, NormIdentity>(imageBGRA.data, imageBGRA.step, imageBGRA.cols, imageBGRA.rows, inputTensorValues[0].data()); }
+	void postprocessOutput(cv::Mat &outputImage, ScratchArena &) override { cv::normalize(outputImage, outputImage, 1.0, 0.0, cv::NORM_MINMAX); }
 };
 
 struct ORTModelData
 {
-	std::unique_ptr<Ort::Session> session;
-	std::unique_ptr<Ort::Env> env;
+	std::shared_ptr<Ort::Session> session; // shared with other instances on the same model, see OrtRegistry
+	std::shared_ptr<std::mutex> sessionRunLock; // the registry's run lock for session, held around every Run
+	uint64_t sessionId = 0; // the registry's id for session
 	std::vector<Ort::AllocatedStringPtr> inputNames;
 	std::vector<Ort::AllocatedStringPtr> outputNames;
 	std::vector<Ort::Value> inputTensor;
@@ -23,7 +23,16 @@ target_sources(sl-bgblur-filter PRIVATE
 	"${_this_dir}/sl-bgblur-filter.cpp"
 	"${_this_dir}/BgBlur.cpp"
 	"${_this_dir}/BgBlurGraphics.cpp"
+	"${_this_dir}/BgBlurWorker.cpp"
 	"${_this_dir}/FilterData.cpp"
+	"${_this_dir}/GuidedUpsampler.cpp"
+	"${_this_dir}/InferenceScheduler.cpp"
+	"${_this_dir}/MappedFile.cpp"
+	"${_this_dir}/MaskPostProcessor.cpp"
+	"${_this_dir}/ModelCache.cpp"
+	"${_this_dir}/MaskPropagator.cpp"
+	"${_this_dir}/OrtRegistry.cpp"
+	"${_this_dir}/TilePool.cpp"
 )
 
 add_custom_command(TARGET sl-bgblur-filter POST_BUILD
@@ -32,6 +41,7 @@ add_custom_command(TARGET sl-bgblur-filter POST_BUILD
         "${_this_dir}/bgblurdata/mediapipe.onnx"	
         "${_this_dir}/bgblurdata/mask_alpha_filter.effect"
         "${_this_dir}/bgblurdata/kawase_blur.effect"
+        "${_this_dir}/bgblurdata/mask_sampling.effect"
         $<TARGET_FILE_DIR:sl-bgblur-filter>
 )
 
@@ -46,6 +56,7 @@ install(FILES
     "${_this_dir}/bgblurdata/mediapipe.onnx"
     "${_this_dir}/bgblurdata/mask_alpha_filter.effect"
     "${_this_dir}/bgblurdata/kawase_blur.effect"
+    "${_this_dir}/bgblurdata/mask_sampling.effect"
     DESTINATION "${OBS_PLUGIN_DESTINATION}"
 )
 
@@ -0,0 +1,122 @@
+#include "OrtRegistry.h"
+#include "InferenceScheduler.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <thread>
+
+/*static*/
+OrtRegistry &OrtRegistry::instance()
+{
+	// Never destroyed: sessions are released by their filters, and tearing ORT down during static destruction races
+	//	the runtime's own shutdown at module unload
+	static OrtRegistry *registry = new OrtRegistry();
+	return *registry;
+}
+
+OrtRegistry::OrtRegistry()
+{
+	globalIntraOpThreads = std::clamp(std::thread::hardware_concurrency() / 2, 1u, (uint32_t)ORT_GLOBAL_MAX_INTRA_OP_THREADS);
+
+	Ort::ThreadingOptions threading;
+	threading.SetGlobalIntraOpNumThreads((int)globalIntraOpThreads);
+	threading.SetGlobalInterOpNumThreads(1);
+
+	// Inference runs at most once per video frame, so spinning between runs would only burn cores
+	threading.SetGlobalSpinControl(0);
+
+	ortEnv = std::make_unique<Ort::Env>(threading, OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "bgremove-ort");
+	prepackedWeights = std::make_unique<Ort::PrepackedWeightsContainer>();
+
+	// One arena for all sessions, grown by exactly what is requested rather than doubling: the warm-up runs after each
+	//	session load take it to the models' peak, and steady-state frames then allocate nothing new
+	Ort::MemoryInfo arenaInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+	Ort::ArenaCfg arenaCfg(0, ORT_ARENA_EXTEND_SAME_AS_REQUESTED, -1, -1);
+	ortEnv->CreateAndRegisterAllocator(arenaInfo, arenaCfg);
+
+	blog(LOG_INFO, "BgBlur ORT registry: global intra-op threads=%u", globalIntraOpThreads);
+}
+
+OrtSharedSession OrtRegistry::acquireSession(const std::wstring &modelPath, const std::string &optionsKey, const Ort::SessionOptions &options,
+					     const std::wstring &loadPath, bool usesModelBytes)
+{
+	const std::wstring key = modelPath + L"|" + std::wstring(optionsKey.begin(), optionsKey.end());
+
+	// Held while creating, so instances asking for the same session at once wait for one build instead of racing
+	std::lock_guard<std::mutex> guard(lock);
+
+	CachedSession &cached = sessions[key];
+
+	if (std::shared_ptr<Ort::Session> session = cached.session.lock())
+		return OrtSharedSession{session, cached.runLock, cached.id};
+
+	const std::wstring &path = loadPath.empty() ? modelPath : loadPath;
+	const uint64_t id = ++lastSessionId;
+	std::shared_ptr<Ort::Session> session;
+
+	if (std::shared_ptr<MappedFile> mapped = mapFile(path))
+	{
+		Ort::Session *created = new Ort::Session(*ortEnv, mapped->data(), mapped->size(), options, *prepackedWeights);
+
+		// With use_ort_model_bytes_directly the session keeps pointers into the mapping, so it holds the mapping until
+		//	it is destroyed. Otherwise the model was parsed and copied, and the mapping goes with the last build on it.
+		if (usesModelBytes)
+		{
+			session = std::shared_ptr<Ort::Session>(created, [mapped, id](Ort::Session *s) {
+				InferenceScheduler::instance().release(id);
+				delete s;
+			});
+		}
+		else
+		{
+			session = std::shared_ptr<Ort::Session>(created, [id](Ort::Session *s) {
+				InferenceScheduler::instance().release(id);
+				delete s;
+			});
+		}
+	}
+	else
+	{
+		Ort::Session *created = new Ort::Session(*ortEnv, path.c_str(), options, *prepackedWeights);
+		session = std::shared_ptr<Ort::Session>(created, [id](Ort::Session *s) {
+			InferenceScheduler::instance().release(id);
+			delete s;
+		});
+	}
+
+	// Users of an older session on this key keep its run lock; they never Run this one
+	OrtSharedSession shared{session, std::make_shared<std::mutex>(), id};
+	cached.session = shared.session;
+	cached.runLock = shared.runLock;
+	cached.id = id;
+
+	// Taken before the registry lock is released, so no one else gets to run the session cold
+	shared.warmupLock = std::unique_lock<std::mutex>(*shared.runLock);
+
+	// Drop entries whose sessions or mappings are gone
+	for (auto it = sessions.begin(); it != sessions.end();)
+		it = it->second.session.expired() ? sessions.erase(it) : std::next(it);
+
+	for (auto it = mappings.begin(); it != mappings.end();)
+		it = it->second.expired() ? mappings.erase(it) : std::next(it);
+
+	return shared;
+}
+
+std::shared_ptr<MappedFile> OrtRegistry::mapFile(const std::wstring &path)
+{
+	if (std::shared_ptr<MappedFile> mapped = mappings[path].lock())
+		return mapped;
+
+	auto mapped = std::make_shared<MappedFile>();
+
+	if (!mapped->open(path))
+	{
+		blog(LOG_WARNING, "BgBlur ORT registry: could not map the model, loading it by path");
+		return nullptr;
+	}
+
+	mappings[path] = mapped;
+	return mapped;
+}
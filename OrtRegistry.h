@@ -0,0 +1,76 @@
+#pragma once
+
+#include <onnxruntime_cxx_api.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "MappedFile.h"
+
+// Upper bound for the process-wide intra-op pool; segmentation models stop scaling well before this
+#define ORT_GLOBAL_MAX_INTRA_OP_THREADS 4
+
+// Shared CPU arena growth: kSameAsRequested, so after warm-up it holds exactly the peak the models reached
+#define ORT_ARENA_EXTEND_SAME_AS_REQUESTED 1
+
+// A registry session as handed to its users
+struct OrtSharedSession
+{
+	std::shared_ptr<Ort::Session> session;
+	std::shared_ptr<std::mutex> runLock; // held around every Run of the session, see OrtRegistry
+	uint64_t id = 0; // never reused, unlike the session's address
+	std::unique_lock<std::mutex> warmupLock; // holds runLock when this call built the session, for its warm-up runs
+};
+
+/**
+ * Process-wide ONNX Runtime state shared by every filter instance
+ * One Env with global thread pools, so N sources don't each run their own intra-op pool competing for the same
+ * cores, and a cache of sessions keyed by model path, execution provider and session options: instances on the same
+ * model share one copy of the optimized graph and weights. Their Runs are serialized on a run lock that comes with the
+ * session: the CPU provider would allow concurrent Runs, but DirectML does not. Prepacked weights are shared across
+ * sessions too. Models are read through shared read-only mappings, and sessions on an optimized cache entry keep
+ * their initializers in the mapping instead of a private copy of the weights. CPU tensors of every session come from
+ * one env-registered arena (sessions set session.use_env_allocators). A session is released with its last user, which
+ * also drops its InferenceScheduler queue, and a mapping with the last session reading it in place (or right after the
+ * build when the model was parsed into the session). IO buffers and recurrent state (ModelRVM) stay per instance.
+ */
+class OrtRegistry
+{
+public:
+	static OrtRegistry &instance();
+
+	Ort::Env &env() { return *ortEnv; }
+	uint32_t intraOpThreads() const { return globalIntraOpThreads; }
+
+	// Cached session for the key and its run lock, or a new one from options, returned with its run lock held (see
+	//	OrtSharedSession::warmupLock) so other instances only run it once it is warm. Options without per-session threads must call
+	//	DisablePerSessionThreads() so the session runs on the global pools. A new session is built from loadPath when
+	//	given (an optimized copy of modelPath, see ModelCache) but cached under modelPath. Pass usesModelBytes when the
+	//	options set session.use_ort_model_bytes_directly, so the session keeps the model's mapping for its lifetime.
+	//	Throws Ort::Exception on failure.
+	OrtSharedSession acquireSession(const std::wstring &modelPath, const std::string &optionsKey, const Ort::SessionOptions &options,
+					const std::wstring &loadPath = std::wstring(), bool usesModelBytes = false);
+
+private:
+	OrtRegistry();
+
+	struct CachedSession
+	{
+		std::weak_ptr<Ort::Session> session;
+		std::shared_ptr<std::mutex> runLock;
+		uint64_t id = 0;
+	};
+
+	std::mutex lock;
+	uint32_t globalIntraOpThreads = 1;
+	uint64_t lastSessionId = 0; // guarded by lock
+	std::unique_ptr<Ort::Env> ortEnv;
+	std::unique_ptr<Ort::PrepackedWeightsContainer> prepackedWeights;
+	std::map<std::wstring, CachedSession> sessions; // guarded by lock
+	std::map<std::wstring, std::weak_ptr<MappedFile>> mappings; // guarded by lock, by file path
+
+	std::shared_ptr<MappedFile> mapFile(const std::wstring &path);
+};
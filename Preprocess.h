@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BGBLUR_PREPROCESS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define BGBLUR_PREPROCESS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC allows AVX2 intrinsics without /arch:AVX2, GCC/Clang need the target attribute. Either way the AVX2 path is
+//	only taken after a runtime CPU check, so the plugin still loads on machines without it.
+#if defined(BGBLUR_PREPROCESS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BGBLUR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BGBLUR_TARGET_AVX2
+#endif
+
+/**
+ * Fused BGRA8 -> float tensor preprocessing
+ * One pass that reads the BGRA8 frame, swizzles to RGB, applies out = rgb * scale + bias per channel and writes straight
+ * into the ORT input tensor, in either BHWC (interleaved) or BCHW (planar) layout. Each model supplies its normalization
+ * as a struct with constexpr scale/bias arrays (RGB order), so every model class gets its own specialized kernel.
+ */
+
+enum class TensorLayout
+{
+	BHWC,
+	BCHW
+};
+
+// x / 255
+struct NormUnit
+{
+	static constexpr float scale[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+	static constexpr float bias[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// Raw 0..255
+struct NormIdentity
+{
+	static constexpr float scale[3] = {1.0f, 1.0f, 1.0f};
+	static constexpr float bias[3] = {0.0f, 0.0f, 0.0f};
+};
+
+#if defined(BGBLUR_PREPROCESS_X86)
+
+static inline bool cpuHasAVX2()
+{
+	static const bool hasAVX2 = [] {
+		int info[4] = {};
+#ifdef _MSC_VER
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		(void)info;
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+	return hasAVX2;
+}
+
+template<TensorLayout Layout>
+BGBLUR_TARGET_AVX2 static inline int preprocessRowAVX2(const uint8_t *src, int width, float *dst, size_t planeSize, const float *scale, const float *bias)
+{
+	int x = 0;
+
+	if constexpr (Layout == TensorLayout::BCHW)
+	{
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256 scaleR = _mm256_set1_ps(scale[0]), scaleG = _mm256_set1_ps(scale[1]), scaleB = _mm256_set1_ps(scale[2]);
+		const __m256 biasR = _mm256_set1_ps(bias[0]), biasG = _mm256_set1_ps(bias[1]), biasB = _mm256_set1_ps(bias[2]);
+
+		for (; x + 8 <= width; x += 8)
+		{
+			const __m256i px = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+			const __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(px, byteMask));
+			const __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask));
+			const __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask));
+
+			_mm256_storeu_ps(dst + x, _mm256_add_ps(_mm256_mul_ps(r, scaleR), biasR));
+			_mm256_storeu_ps(dst + planeSize + x, _mm256_add_ps(_mm256_mul_ps(g, scaleG), biasG));
+			_mm256_storeu_ps(dst + 2 * planeSize + x, _mm256_add_ps(_mm256_mul_ps(b, scaleB), biasB));
+		}
+	}
+	else
+	{
+		(void)planeSize;
+
+		// 4 BGRA pixels -> 12 RGB bytes
+		const __m128i toRGB = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+		// 8 pixels = 24 floats = 3 vectors, each starting at a different channel phase
+		const __m256 scale0 = _mm256_setr_ps(scale[0], scale[1], scale[2], scale[0], scale[1], scale[2], scale[0], scale[1]);
+		const __m256 scale1 = _mm256_setr_ps(scale[2], scale[0], scale[1], scale[2], scale[0], scale[1], scale[2], scale[0]);
+		const __m256 scale2 = _mm256_setr_ps(scale[1], scale[2], scale[0], scale[1], scale[2], scale[0], scale[1], scale[2]);
+		const __m256 bias0 = _mm256_setr_ps(bias[0], bias[1], bias[2], bias[0], bias[1], bias[2], bias[0], bias[1]);
+		const __m256 bias1 = _mm256_setr_ps(bias[2], bias[0], bias[1], bias[2], bias[0], bias[1], bias[2], bias[0]);
+		const __m256 bias2 = _mm256_setr_ps(bias[1], bias[2], bias[0], bias[1], bias[2], bias[0], bias[1], bias[2]);
+
+		alignas(32) uint8_t rgb[32];
+
+		for (; x + 8 <= width; x += 8)
+		{
+			const __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + x * 4)), toRGB);
+			const __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + x * 4 + 16)), toRGB);
+			_mm_storeu_si128((__m128i *)rgb, lo);
+			_mm_storeu_si128((__m128i *)(rgb + 12), hi);
+
+			const __m256 v0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)rgb)));
+			const __m256 v1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(rgb + 8))));
+			const __m256 v2 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(rgb + 16))));
+
+			float *out = dst + x * 3;
+			_mm256_storeu_ps(out, _mm256_add_ps(_mm256_mul_ps(v0, scale0), bias0));
+			_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_mul_ps(v1, scale1), bias1));
+			_mm256_storeu_ps(out + 16, _mm256_add_ps(_mm256_mul_ps(v2, scale2), bias2));
+		}
+	}
+
+	return x;
+}
+
+#elif defined(BGBLUR_PREPROCESS_NEON)
+
+template<TensorLayout Layout> static inline int preprocessRowNEON(const uint8_t *src, int width, float *dst, size_t planeSize, const float *scale, const float *bias)
+{
+	const float32x4_t scaleR = vdupq_n_f32(scale[0]), scaleG = vdupq_n_f32(scale[1]), scaleB = vdupq_n_f32(scale[2]);
+	const float32x4_t biasR = vdupq_n_f32(bias[0]), biasG = vdupq_n_f32(bias[1]), biasB = vdupq_n_f32(bias[2]);
+
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		// val[0..3] = B, G, R, A planes of 16 pixels
+		const uint8x16x4_t px = vld4q_u8(src + x * 4);
+		const uint16x8_t r16[2] = {vmovl_u8(vget_low_u8(px.val[2])), vmovl_u8(vget_high_u8(px.val[2]))};
+		const uint16x8_t g16[2] = {vmovl_u8(vget_low_u8(px.val[1])), vmovl_u8(vget_high_u8(px.val[1]))};
+		const uint16x8_t b16[2] = {vmovl_u8(vget_low_u8(px.val[0])), vmovl_u8(vget_high_u8(px.val[0]))};
+
+		for (int q = 0; q < 4; ++q)
+		{
+			const uint16x8_t &r8 = r16[q >> 1], &g8 = g16[q >> 1], &b8 = b16[q >> 1];
+			const float32x4_t r = vcvtq_f32_u32((q & 1) ? vmovl_high_u16(r8) : vmovl_u16(vget_low_u16(r8)));
+			const float32x4_t g = vcvtq_f32_u32((q & 1) ? vmovl_high_u16(g8) : vmovl_u16(vget_low_u16(g8)));
+			const float32x4_t b = vcvtq_f32_u32((q & 1) ? vmovl_high_u16(b8) : vmovl_u16(vget_low_u16(b8)));
+
+			float32x4x3_t out;
+			out.val[0] = vaddq_f32(vmulq_f32(r, scaleR), biasR);
+			out.val[1] = vaddq_f32(vmulq_f32(g, scaleG), biasG);
+			out.val[2] = vaddq_f32(vmulq_f32(b, scaleB), biasB);
+
+			const int px4 = x + q * 4;
+
+			if constexpr (Layout == TensorLayout::BCHW)
+			{
+				vst1q_f32(dst + px4, out.val[0]);
+				vst1q_f32(dst + planeSize + px4, out.val[1]);
+				vst1q_f32(dst + 2 * planeSize + px4, out.val[2]);
+			}
+			else
+			{
+				vst3q_f32(dst + px4 * 3, out);
+			}
+		}
+	}
+
+	return x;
+}
+
+#endif
+
+template<TensorLayout Layout> static inline void preprocessRowScalar(const uint8_t *src, int x, int width, float *dst, size_t planeSize, const float *scale, const float *bias)
+{
+	for (; x < width; ++x)
+	{
+		const uint8_t *px = src + x * 4;
+		const float r = px[2] * scale[0] + bias[0];
+		const float g = px[1] * scale[1] + bias[1];
+		const float b = px[0] * scale[2] + bias[2];
+
+		if constexpr (Layout == TensorLayout::BCHW)
+		{
+			dst[x] = r;
+			dst[planeSize + x] = g;
+			dst[2 * planeSize + x] = b;
+		}
+		else
+		{
+			dst[x * 3 + 0] = r;
+			dst[x * 3 + 1] = g;
+			dst[x * 3 + 2] = b;
+		}
+	}
+}
+
+// src is a width x height BGRA8 image with the given row stride in bytes, dst holds width * height * 3 floats
+template<TensorLayout Layout, class Norm> static inline void fusedPreprocessBGRA(const uint8_t *src, size_t srcStep, int width, int height, float *dst)
+{
+	const size_t planeSize = (size_t)width * height;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+	const bool useAVX2 = cpuHasAVX2();
+#endif
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t *row = src + y * srcStep;
+		float *out = (Layout == TensorLayout::BCHW) ? dst + (size_t)y * width : dst + (size_t)y * width * 3;
+		int x = 0;
+
+#if defined(BGBLUR_PREPROCESS_X86)
+		if (useAVX2)
+			x = preprocessRowAVX2<Layout>(row, width, out, planeSize, Norm::scale, Norm::bias);
+#elif defined(BGBLUR_PREPROCESS_NEON)
+		x = preprocessRowNEON<Layout>(row, width, out, planeSize, Norm::scale, Norm::bias);
+#endif
+
+		preprocessRowScalar<Layout>(row, x, width, out, planeSize, Norm::scale, Norm::bias);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <obs-module.h>
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+// Named buffers the mask pipeline borrows each frame
+enum ScratchSlot
+{
+	SCRATCH_RESIZED_BGRA,   // frame resized to the network input (CPU downscale path)
+	SCRATCH_MODEL_CHANNEL,  // single channel pulled out of a multi-channel network output
+	SCRATCH_MODEL_OUTPUT,   // post-processed float network output
+	SCRATCH_OUTPUT_8U,      // network output converted to 8-bit
+	SCRATCH_NETWORK_MASK,   // mask at network resolution
+	SCRATCH_SLOT_COUNT
+};
+
+/**
+ * Per-filter scratch arena
+ * Buffers live across frames and are only reallocated when the frame size, model or settings change their shape.
+ * Any reallocation of an already sized buffer without such a change is a steady-state allocation: it is counted in
+ * the stats and the first one after each shape change is logged; debug builds assert.
+ */
+class ScratchArena
+{
+public:
+	// Call at the start of every mask build with everything that legitimately changes buffer shapes: the source frame,
+	//	the staged image, and the inference ROI and its content within the staged image (a full-frame pass and an ROI
+	//	pass paste into differently sized masks)
+	void beginFrame(const cv::Size &frameSize, const cv::Size &stageSize, const cv::Size &roiSize, const cv::Size &contentSize)
+	{
+		frameAllocations = 0;
+		steadyState = !resetRequested.exchange(false) && frameSize == lastFrameSize && stageSize == lastStageSize && roiSize == lastRoiSize &&
+			      contentSize == lastContentSize;
+
+		if (!steadyState)
+			loggedSteadyStateAllocation = false;
+
+		lastFrameSize = frameSize;
+		lastStageSize = stageSize;
+		lastRoiSize = roiSize;
+		lastContentSize = contentSize;
+	}
+
+	void endFrame()
+	{
+		if (!steadyState || frameAllocations == 0)
+			return;
+
+		steadyStateAllocations += frameAllocations;
+
+		if (!loggedSteadyStateAllocation)
+		{
+			blog(LOG_WARNING, "BgBlur scratch arena: %u buffer(s) reallocated in steady state", frameAllocations);
+			loggedSteadyStateAllocation = true;
+		}
+
+		// Debug builds stop on the first one so the offending buffer is caught where it happens
+		assert(frameAllocations == 0 && "scratch buffer reallocated in steady state");
+	}
+
+	// Buffers may change shape on the next frame (model or settings change). Safe to call from any thread.
+	void invalidate() { resetRequested = true; }
+
+	cv::Mat &get(ScratchSlot slot, const cv::Size &size, int type)
+	{
+		ensure(buffers[slot], size, type);
+		return buffers[slot];
+	}
+
+	// Slot buffer as-is, for outputs that ensure() their own shape
+	cv::Mat &at(ScratchSlot slot) { return buffers[slot]; }
+
+	// Same accounting for buffers owned elsewhere (history, double buffers)
+	void ensure(cv::Mat &mat, const cv::Size &size, int type)
+	{
+		if (mat.size() == size && mat.type() == type)
+			return;
+
+		// First-time allocations are expected, only resizes of a live buffer count
+		if (!mat.empty())
+			++frameAllocations;
+
+		mat.create(size, type);
+	}
+
+	std::atomic<uint64_t> steadyStateAllocations{0};
+
+private:
+	cv::Mat buffers[SCRATCH_SLOT_COUNT];
+	cv::Size lastFrameSize;
+	cv::Size lastStageSize;
+	cv::Size lastRoiSize;
+	cv::Size lastContentSize;
+	uint32_t frameAllocations = 0;
+	bool steadyState = false;
+	bool loggedSteadyStateAllocation = false;
+	std::atomic<bool> resetRequested{false};
+};
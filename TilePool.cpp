@@ -0,0 +1,109 @@
+#include "TilePool.h"
+
+#include <algorithm>
+
+std::atomic<uint32_t> TilePool::livePools{0};
+
+/*static*/
+uint32_t TilePool::share(uint32_t budget)
+{
+	return std::max(1u, budget / std::max(1u, livePools.load()));
+}
+
+void TilePool::resize(uint32_t workers)
+{
+	workers = std::max(1u, workers);
+
+	if (workers == this->workers())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	threads.clear();
+
+	std::lock_guard<std::mutex> guard(lock);
+	stopping = false;
+
+	for (uint32_t i = 1; i < workers; ++i)
+		threads.emplace_back(&TilePool::workerLoop, this, (int)i, generation);
+}
+
+void TilePool::run(int tileCount, const std::function<void(int, int)> &fn)
+{
+	if (tileCount <= 0)
+		return;
+
+	if (threads.empty() || tileCount == 1)
+	{
+		for (int tile = 0; tile < tileCount; ++tile)
+			fn(tile, 0);
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = &fn;
+		jobTiles = tileCount;
+		nextTile = 0;
+		busyWorkers = (int)threads.size();
+		++generation;
+	}
+
+	wake.notify_all();
+
+	for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+		fn(tile, 0);
+
+	// Every worker checks in before returning, so the next run can't start while one still looks at this job
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return busyWorkers == 0; });
+	job = nullptr;
+}
+
+int TilePool::tileCount(int rows) const
+{
+	const int maxTiles = std::max(1, rows / TILE_POOL_MIN_ROWS);
+	return std::clamp((int)workers() * 2, 1, maxTiles);
+}
+
+/*static*/
+void TilePool::tileRows(int rows, int tileCount, int tile, int &y0, int &y1)
+{
+	y0 = (int)((int64_t)rows * tile / tileCount);
+	y1 = (int)((int64_t)rows * (tile + 1) / tileCount);
+}
+
+void TilePool::workerLoop(int worker, uint64_t generationSeen)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	for (;;)
+	{
+		wake.wait(guard, [&] { return stopping || generation != generationSeen; });
+
+		if (stopping)
+			return;
+
+		generationSeen = generation;
+		const std::function<void(int, int)> *fn = job;
+		const int tiles = jobTiles;
+		guard.unlock();
+
+		for (int tile = nextTile++; tile < tiles; tile = nextTile++)
+			(*fn)(tile, worker);
+
+		guard.lock();
+
+		if (--busyWorkers == 0)
+			done.notify_one();
+	}
+}
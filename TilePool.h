@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Smallest row tile worth handing to another thread
+#define TILE_POOL_MIN_ROWS 32
+
+/**
+ * Row-tile worker pool for the full-resolution mask stages
+ * run() blocks until every tile is done, and the calling thread works on tiles too, so a pool of N workers owns
+ * N - 1 threads. Only the thread that owns the pool (the mask worker) may call run() and resize(). Every filter instance
+ * has its own pool and their mask workers run at the same time, so pools are sized with share() of a process-wide budget.
+ */
+class TilePool
+{
+public:
+	TilePool() { ++livePools; }
+	~TilePool()
+	{
+		resize(1);
+		--livePools;
+	}
+
+	// Total workers including the calling thread (at least 1)
+	void resize(uint32_t workers);
+	uint32_t workers() const { return (uint32_t)threads.size() + 1; }
+
+	// One pool's part of a worker budget for the whole process: the budget split evenly over the live pools
+	static uint32_t share(uint32_t budget);
+
+	// fn(tile, worker) for every tile in [0, tileCount); worker < workers() tells which per-worker buffers to use
+	void run(int tileCount, const std::function<void(int, int)> &fn);
+
+	// Splits rows into about two tiles per worker, so an unlucky slow tile doesn't hold up the others
+	int tileCount(int rows) const;
+	static void tileRows(int rows, int tileCount, int tile, int &y0, int &y1);
+
+private:
+	void workerLoop(int worker, uint64_t generationSeen);
+
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int, int)> *job = nullptr; // guarded by lock
+	int jobTiles = 0;                                    // guarded by lock
+	uint64_t generation = 0;                             // guarded by lock
+	int busyWorkers = 0;                                 // guarded by lock
+	bool stopping = false;                               // guarded by lock
+	std::atomic<int> nextTile{0};
+
+	static std::atomic<uint32_t> livePools;
+};